@@ -0,0 +1,435 @@
+// Comparative benchmark: rbtree against std::multiset, a simple B+ tree,
+// the bucketed bktree and a sorted vector, on identical workloads.
+//
+//   ./bench [--min=N] [--max=N] [--workloads=a,b] [--impls=a,b]
+//
+// For each size and workload every implementation runs the same operation
+// stream: insert, find, min/max, to_array, churn (erase + insert pairs) and
+// erase. Throughput is measured over the whole phase; latency percentiles
+// come from timing every LAT_SAMPLE-th operation individually (each sample
+// includes ~20ns of clock overhead). Bytes per element is the malloc heap
+// growth after the insert phase. Cache misses come from perf_event_open and
+// print as "-" where the kernel does not allow it.
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "bktree.h"
+#include "btree.hpp"
+#include "rbtree.h"
+
+namespace {
+
+const int LAT_SAMPLE = 16;
+
+// sorted vector insert is O(n); above this size it is bulk loaded instead
+const size_t SORTED_VECTOR_INSERT_LIMIT = 200000;
+
+// ---------------------------------------------------------------------------
+// implementations
+
+struct Rbtree {
+  static const char *name() { return "rbtree"; }
+  rbtree *t = new_rbtree();
+  ~Rbtree() { delete_rbtree(t); }
+  void insert(int k) { rbtree_insert(t, k); }
+  bool find(int k) { return rbtree_find(t, k) != nullptr; }
+  bool erase(int k) {
+    node_t *p = rbtree_find(t, k);
+    if (p == nullptr) return false;
+    rbtree_erase(t, p);
+    return true;
+  }
+  int min() { return rbtree_min(t)->key; }
+  int max() { return rbtree_max(t)->key; }
+  void to_array(int *arr, size_t n) { rbtree_to_array(t, arr, n); }
+};
+
+struct Bktree {
+  static const char *name() { return "bktree"; }
+  bktree *t = new_bktree();
+  ~Bktree() { delete_bktree(t); }
+  void insert(int k) { bktree_insert(t, k); }
+  bool find(int k) { return bktree_find(t, k); }
+  bool erase(int k) { return bktree_erase(t, k) == 0; }
+  int min() {
+    key_t k = 0;
+    bktree_min(t, &k);
+    return k;
+  }
+  int max() {
+    key_t k = 0;
+    bktree_max(t, &k);
+    return k;
+  }
+  void to_array(int *arr, size_t n) { bktree_to_array(t, arr, n); }
+};
+
+struct Multiset {
+  static const char *name() { return "std::multiset"; }
+  std::multiset<int> s;
+  void insert(int k) { s.insert(k); }
+  bool find(int k) { return s.find(k) != s.end(); }
+  bool erase(int k) {
+    auto it = s.find(k);
+    if (it == s.end()) return false;
+    s.erase(it);
+    return true;
+  }
+  int min() { return *s.begin(); }
+  int max() { return *s.rbegin(); }
+  void to_array(int *arr, size_t n) {
+    size_t i = 0;
+    for (auto it = s.begin(); it != s.end() && i < n; ++it) arr[i++] = *it;
+  }
+};
+
+struct Btree {
+  static const char *name() { return "b+tree"; }
+  BPlusTree<64> b;
+  void insert(int k) { b.insert(k); }
+  bool find(int k) { return b.find(k); }
+  bool erase(int k) { return b.erase(k); }
+  int min() {
+    int k = 0;
+    b.min(&k);
+    return k;
+  }
+  int max() {
+    int k = 0;
+    b.max(&k);
+    return k;
+  }
+  void to_array(int *arr, size_t n) { b.to_array(arr, n); }
+};
+
+struct SortedVector {
+  static const char *name() { return "sorted vector"; }
+  std::vector<int> v;
+  bool bulk = false;  // append now, sort in finish_bulk()
+  void insert(int k) {
+    if (bulk) {
+      v.push_back(k);
+      return;
+    }
+    v.insert(std::upper_bound(v.begin(), v.end(), k), k);
+  }
+  void finish_bulk() {
+    std::sort(v.begin(), v.end());
+    bulk = false;
+  }
+  bool find(int k) { return std::binary_search(v.begin(), v.end(), k); }
+  bool erase(int k) {
+    auto it = std::lower_bound(v.begin(), v.end(), k);
+    if (it == v.end() || *it != k) return false;
+    v.erase(it);
+    return true;
+  }
+  int min() { return v.front(); }
+  int max() { return v.back(); }
+  void to_array(int *arr, size_t n) {
+    std::copy(v.begin(), v.begin() + std::min(n, v.size()), arr);
+  }
+};
+
+// ---------------------------------------------------------------------------
+// key streams
+
+struct Rng {
+  uint64_t s;
+  explicit Rng(uint64_t seed) : s(seed * 0x9E3779B97F4A7C15ull + 1) {}
+  uint64_t next() {
+    s ^= s << 13;
+    s ^= s >> 7;
+    s ^= s << 17;
+    return s;
+  }
+  double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+};
+
+// scatter ranks over the key space so hot keys are not adjacent
+int scatter(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  return static_cast<int>(x & 0x7fffffff);
+}
+
+// Zipf(theta) over [0, n) using the Gray et al. closed-form generator
+struct Zipf {
+  double theta, alpha, zetan, eta;
+  uint64_t n;
+  Zipf(uint64_t items, double t) : theta(t), n(items) {
+    zetan = 0;
+    for (uint64_t i = 1; i <= n; i++) zetan += 1.0 / std::pow(i, theta);
+    double zeta2 = 1.0 + 1.0 / std::pow(2, theta);
+    alpha = 1.0 / (1.0 - theta);
+    eta = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+  }
+  uint64_t next(Rng &rng) const {
+    double u = rng.uniform(), uz = u * zetan;
+    if (uz < 1.0) return 0;
+    if (uz < 1.0 + std::pow(0.5, theta)) return 1;
+    return static_cast<uint64_t>(n * std::pow(eta * u - eta + 1, alpha)) % n;
+  }
+};
+
+struct Workload {
+  std::string name;
+  std::vector<int> inserts;  // keys inserted in the build phase
+  std::vector<int> lookups;  // keys searched in the find phase
+  std::vector<int> fresh;    // new keys inserted in the churn phase
+};
+
+Workload make_workload(const std::string &name, size_t n) {
+  Workload w;
+  w.name = name;
+  Rng rng(n);
+  w.inserts.resize(n);
+  w.lookups.resize(n);
+  w.fresh.resize(n / 2);
+
+  if (name == "sequential") {
+    for (size_t i = 0; i < n; i++) w.inserts[i] = static_cast<int>(i);
+    for (size_t i = 0; i < n; i++) w.lookups[i] = rng.next() % (2 * n);
+    for (size_t i = 0; i < n / 2; i++) w.fresh[i] = static_cast<int>(n + i);
+  } else if (name == "zipfian") {
+    Zipf z(n, 0.99);
+    for (size_t i = 0; i < n; i++) w.inserts[i] = scatter(z.next(rng));
+    for (size_t i = 0; i < n; i++) w.lookups[i] = scatter(z.next(rng));
+    for (size_t i = 0; i < n / 2; i++) w.fresh[i] = scatter(z.next(rng));
+  } else {  // uniform, churn
+    for (size_t i = 0; i < n; i++) w.inserts[i] = rng.next() & 0x7fffffff;
+    for (size_t i = 0; i < n; i++) {
+      // half hits, half (almost certain) misses
+      w.lookups[i] = (i % 2) ? w.inserts[rng.next() % n]
+                             : static_cast<int>(rng.next() & 0x7fffffff);
+    }
+    for (size_t i = 0; i < n / 2; i++) w.fresh[i] = rng.next() & 0x7fffffff;
+  }
+  return w;
+}
+
+// ---------------------------------------------------------------------------
+// measurement
+
+struct CacheMisses {
+  int fd = -1;
+  CacheMisses() {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  ~CacheMisses() {
+    if (fd >= 0) close(fd);
+  }
+  long long read_count() const {
+    long long v = 0;
+    if (fd < 0 || ::read(fd, &v, sizeof(v)) != sizeof(v)) return -1;
+    return v;
+  }
+};
+
+CacheMisses *misses;
+
+inline uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+struct Phase {
+  const char *name;
+  size_t ops = 0;
+  uint64_t total_ns = 0;
+  long long misses = -1;
+  std::vector<uint32_t> samples;
+};
+
+// run op(i) for i in [0, n) and record throughput, latency and misses
+template <class Op>
+Phase measure(const char *name, size_t n, Op op) {
+  Phase p;
+  p.name = name;
+  p.ops = n;
+  p.samples.reserve(n / LAT_SAMPLE + 1);
+  long long m0 = misses->read_count();
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < n; i++) {
+    if (i % LAT_SAMPLE == 0) {
+      uint64_t t0 = now_ns();
+      op(i);
+      p.samples.push_back(static_cast<uint32_t>(now_ns() - t0));
+    } else {
+      op(i);
+    }
+  }
+  p.total_ns = now_ns() - start;
+  long long m1 = misses->read_count();
+  if (m0 >= 0 && m1 >= 0) p.misses = m1 - m0;
+  return p;
+}
+
+double percentile(std::vector<uint32_t> &v, double q) {
+  if (v.empty()) return 0;
+  size_t i = static_cast<size_t>(q * (v.size() - 1));
+  std::nth_element(v.begin(), v.begin() + i, v.end());
+  return v[i];
+}
+
+void report(const char *impl, const Workload &w, size_t n, Phase &p,
+            double bytes_per_elem) {
+  char miss[32] = "-";
+  if (p.misses >= 0 && p.ops > 0) {
+    snprintf(miss, sizeof(miss), "%.2f", static_cast<double>(p.misses) / p.ops);
+  }
+  char bytes[32] = "";
+  if (bytes_per_elem >= 0) snprintf(bytes, sizeof(bytes), "%.1f", bytes_per_elem);
+  printf("%10zu %-11s %-14s %-9s %10.2f %8.0f %8.0f %8.0f %8s %8s\n", n,
+         w.name.c_str(), impl, p.name,
+         p.total_ns ? p.ops * 1e3 / p.total_ns : 0.0, percentile(p.samples, 0.5),
+         percentile(p.samples, 0.99), percentile(p.samples, 0.999), miss, bytes);
+}
+
+size_t heap_in_use() { return mallinfo2().uordblks; }
+
+volatile long long sink;
+
+template <class Impl>
+void run(const Workload &w) {
+  const size_t n = w.inserts.size();
+  long long acc = 0;
+  size_t heap0 = heap_in_use();
+  Impl *impl = new Impl();
+
+  // build
+  bool bulk = false;
+  if constexpr (std::is_same<Impl, SortedVector>::value) {
+    bulk = n > SORTED_VECTOR_INSERT_LIMIT;
+    impl->bulk = bulk;
+  }
+  Phase insert = measure(bulk ? "insert*" : "insert", n,
+                         [&](size_t i) { impl->insert(w.inserts[i]); });
+  if constexpr (std::is_same<Impl, SortedVector>::value) {
+    if (bulk) impl->finish_bulk();
+  }
+  double bytes = static_cast<double>(heap_in_use() - heap0) / n;
+  report(Impl::name(), w, n, insert, bytes);
+
+  Phase find = measure("find", n, [&](size_t i) { acc += impl->find(w.lookups[i]); });
+  report(Impl::name(), w, n, find, -1);
+
+  Phase minmax = measure("min/max", std::min<size_t>(n, 100000),
+                         [&](size_t) { acc += impl->min() + impl->max(); });
+  report(Impl::name(), w, n, minmax, -1);
+
+  std::vector<int> out(n);
+  Phase to_array = measure("to_array", 1, [&](size_t) { impl->to_array(out.data(), n); });
+  to_array.ops = n;  // report per element
+  report(Impl::name(), w, n, to_array, -1);
+  acc += out[n / 2];
+
+  // churn: erase a live key, insert a fresh one (sorted vector is O(n) here)
+  if (w.name == "churn" && !bulk) {
+    Phase churn = measure("churn", w.fresh.size(), [&](size_t i) {
+      acc += impl->erase(w.inserts[i]);
+      impl->insert(w.fresh[i]);
+    });
+    report(Impl::name(), w, n, churn, -1);
+  }
+
+  if (!bulk) {
+    Phase erase = measure("erase", n / 2, [&](size_t i) {
+      acc += impl->erase(w.inserts[n - 1 - i]);
+    });
+    report(Impl::name(), w, n, erase, -1);
+  }
+
+  delete impl;
+  sink = acc;
+}
+
+bool selected(const std::string &list, const std::string &name) {
+  if (list.empty()) return true;
+  std::string item;
+  for (size_t i = 0; i <= list.size(); i++) {
+    if (i == list.size() || list[i] == ',') {
+      if (item == name) return true;
+      item.clear();
+    } else {
+      item += list[i];
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  size_t min_n = 1000, max_n = 1000000;
+  std::string workloads, impls;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg.rfind("--min=", 0) == 0) {
+      min_n = std::stoull(arg.substr(6));
+    } else if (arg.rfind("--max=", 0) == 0) {
+      max_n = std::stoull(arg.substr(6));
+    } else if (arg.rfind("--workloads=", 0) == 0) {
+      workloads = arg.substr(12);
+    } else if (arg.rfind("--impls=", 0) == 0) {
+      impls = arg.substr(8);
+    } else {
+      fprintf(stderr,
+              "usage: %s [--min=N] [--max=N] [--workloads=uniform,sequential,"
+              "zipfian,churn]\n          [--impls=rbtree,bktree,multiset,"
+              "btree,vector]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  CacheMisses counter;
+  misses = &counter;
+  if (counter.fd < 0) {
+    printf("# perf_event_open unavailable, cache misses not reported\n");
+  }
+  printf("# insert* = sorted vector bulk loaded (append + sort) above %zu keys\n",
+         SORTED_VECTOR_INSERT_LIMIT);
+  printf("%10s %-11s %-14s %-9s %10s %8s %8s %8s %8s %8s\n", "n", "workload",
+         "impl", "op", "Mops/s", "p50 ns", "p99 ns", "p99.9 ns", "miss/op",
+         "B/elem");
+
+  const char *names[] = {"uniform", "sequential", "zipfian", "churn"};
+  for (size_t n = min_n; n <= max_n; n *= 10) {
+    for (const char *name : names) {
+      if (!selected(workloads, name)) continue;
+      Workload w = make_workload(name, n);
+      if (selected(impls, "rbtree")) run<Rbtree>(w);
+      if (selected(impls, "bktree")) run<Bktree>(w);
+      if (selected(impls, "multiset")) run<Multiset>(w);
+      if (selected(impls, "btree")) run<Btree>(w);
+      if (selected(impls, "vector")) run<SortedVector>(w);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,209 @@
+// Simple in-memory B+ tree multiset used as a baseline by bench.cpp.
+//
+// Leaves hold up to B sorted keys and are doubly linked. Inner nodes hold up
+// to B - 1 separators; every key in child[i] is <= keys[i] <= every key in
+// child[i + 1]. Erase removes the key from its leaf without merging
+// underfull nodes, so empty leaves may stay in the chain until destruction.
+#ifndef _BENCH_BTREE_HPP_
+#define _BENCH_BTREE_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+template <int B>
+class BPlusTree {
+ public:
+  BPlusTree() : root_(new Leaf()), first_(nullptr), last_(nullptr), size_(0) {
+    first_ = last_ = static_cast<Leaf *>(root_);
+  }
+  ~BPlusTree() { destroy(root_); }
+  BPlusTree(const BPlusTree &) = delete;
+  BPlusTree &operator=(const BPlusTree &) = delete;
+
+  void insert(int key) {
+    Split s = insert_rec(root_, key);
+    if (s.right != nullptr) {
+      Inner *root = new Inner();
+      root->n = 1;
+      root->keys[0] = s.key;
+      root->child[0] = root_;
+      root->child[1] = s.right;
+      root_ = root;
+    }
+    size_++;
+  }
+
+  bool find(int key) const {
+    int pos;
+    return locate(key, &pos) != nullptr;
+  }
+
+  bool erase(int key) {
+    int pos;
+    Leaf *leaf = locate(key, &pos);
+    if (leaf == nullptr) {
+      return false;
+    }
+    std::copy(leaf->keys + pos + 1, leaf->keys + leaf->n, leaf->keys + pos);
+    leaf->n--;
+    size_--;
+    return true;
+  }
+
+  bool min(int *key) const {
+    for (Leaf *l = first_; l != nullptr; l = l->next) {
+      if (l->n > 0) {
+        *key = l->keys[0];
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool max(int *key) const {
+    for (Leaf *l = last_; l != nullptr; l = l->prev) {
+      if (l->n > 0) {
+        *key = l->keys[l->n - 1];
+        return true;
+      }
+    }
+    return false;
+  }
+
+  size_t to_array(int *arr, size_t n) const {
+    size_t i = 0;
+    for (Leaf *l = first_; l != nullptr && i < n; l = l->next) {
+      size_t len = std::min<size_t>(l->n, n - i);
+      std::copy(l->keys, l->keys + len, arr + i);
+      i += len;
+    }
+    return i;
+  }
+
+  size_t size() const { return size_; }
+
+ private:
+  struct Node {
+    bool leaf;
+    int n;
+    explicit Node(bool is_leaf) : leaf(is_leaf), n(0) {}
+  };
+  struct Leaf : Node {
+    int keys[B];
+    Leaf *prev = nullptr, *next = nullptr;
+    Leaf() : Node(true) {}
+  };
+  struct Inner : Node {
+    int keys[B];
+    Node *child[B + 1];
+    Inner() : Node(false) {}
+  };
+  struct Split {
+    int key;
+    Node *right;
+  };
+
+  Split insert_rec(Node *node, int key) {
+    if (node->leaf) {
+      Leaf *leaf = static_cast<Leaf *>(node);
+      if (leaf->n < B) {
+        insert_leaf(leaf, key);
+        return {0, nullptr};
+      }
+      // split the full leaf in half, then insert into the proper side
+      Leaf *right = new Leaf();
+      const int mid = B / 2;
+      std::copy(leaf->keys + mid, leaf->keys + B, right->keys);
+      right->n = B - mid;
+      leaf->n = mid;
+      right->next = leaf->next;
+      right->prev = leaf;
+      if (leaf->next != nullptr) {
+        leaf->next->prev = right;
+      } else {
+        last_ = right;
+      }
+      leaf->next = right;
+      insert_leaf(key < right->keys[0] ? leaf : right, key);
+      return {right->keys[0], right};
+    }
+
+    Inner *inner = static_cast<Inner *>(node);
+    const int i = std::upper_bound(inner->keys, inner->keys + inner->n, key) -
+                  inner->keys;
+    Split s = insert_rec(inner->child[i], key);
+    if (s.right == nullptr) {
+      return s;
+    }
+
+    std::copy_backward(inner->keys + i, inner->keys + inner->n,
+                       inner->keys + inner->n + 1);
+    std::copy_backward(inner->child + i + 1, inner->child + inner->n + 1,
+                       inner->child + inner->n + 2);
+    inner->keys[i] = s.key;
+    inner->child[i + 1] = s.right;
+    inner->n++;
+    if (inner->n < B) {
+      return {0, nullptr};
+    }
+
+    // push the middle separator up
+    Inner *right = new Inner();
+    const int mid = B / 2;
+    std::copy(inner->keys + mid + 1, inner->keys + B, right->keys);
+    std::copy(inner->child + mid + 1, inner->child + B + 1, right->child);
+    right->n = B - mid - 1;
+    inner->n = mid;
+    return {inner->keys[mid], right};
+  }
+
+  static void insert_leaf(Leaf *leaf, int key) {
+    int *pos = std::upper_bound(leaf->keys, leaf->keys + leaf->n, key);
+    std::copy_backward(pos, leaf->keys + leaf->n, leaf->keys + leaf->n + 1);
+    *pos = key;
+    leaf->n++;
+  }
+
+  // leftmost leaf that may hold key; equal keys can continue in next leaves
+  Leaf *locate(int key, int *pos) const {
+    Node *node = root_;
+    while (!node->leaf) {
+      Inner *inner = static_cast<Inner *>(node);
+      node = inner->child[std::lower_bound(inner->keys,
+                                           inner->keys + inner->n, key) -
+                          inner->keys];
+    }
+    for (Leaf *leaf = static_cast<Leaf *>(node); leaf != nullptr;
+         leaf = leaf->next) {
+      int i = std::lower_bound(leaf->keys, leaf->keys + leaf->n, key) -
+              leaf->keys;
+      if (i < leaf->n) {
+        if (leaf->keys[i] != key) {
+          return nullptr;
+        }
+        *pos = i;
+        return leaf;
+      }
+    }
+    return nullptr;
+  }
+
+  static void destroy(Node *node) {
+    if (node->leaf) {
+      delete static_cast<Leaf *>(node);
+      return;
+    }
+    Inner *inner = static_cast<Inner *>(node);
+    for (int i = 0; i <= inner->n; i++) {
+      destroy(inner->child[i]);
+    }
+    delete inner;
+  }
+
+  Node *root_;
+  Leaf *first_, *last_;
+  size_t size_;
+};
+
+#endif  // _BENCH_BTREE_HPP_
@@ -0,0 +1,373 @@
+
+#include "bktree.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/////////////////////////////////////////
+
+/**
+ * @brief 빈 버킷을 할당하는 함수. 사용하지 않는 칸은 INT_MAX로 채운다.
+ *
+ * @return bucket_t* 할당한 버킷. 할당에 실패하면 NULL
+ */
+bucket_t *new_bucket(void)
+{
+  bucket_t *b = (bucket_t *)malloc(sizeof(bucket_t));
+  if (b == NULL)
+  {
+    return NULL;
+  }
+
+  b->len = 0;
+  for (int i = 0; i < BKTREE_BUCKET_CAP; i++)
+  {
+    b->keys[i] = INT_MAX;
+  }
+  return b;
+}
+
+/**
+ * @brief 버킷 안에서 key보다 작은 값의 개수(= key를 넣을 위치)를 구하는 함수
+ *
+ * 사용하지 않는 칸은 INT_MAX이므로 len과 관계없이 버킷 전체를 비교해도 결과가 같다.
+ * SSE2가 있으면 4개씩 한 번에 비교한다. (key_t가 32비트 int라고 가정)
+ *
+ * @param b 대상 버킷
+ * @param key 찾는 key 값
+ * @return int key보다 작은 값의 개수
+ */
+int bucket_lower_bound(const bucket_t *b, const key_t key)
+{
+  int cnt = 0;
+
+#ifdef __SSE2__
+  const __m128i target = _mm_set1_epi32(key);
+  for (int i = 0; i < BKTREE_BUCKET_CAP; i += 4)
+  {
+    __m128i keys = _mm_loadu_si128((const __m128i *)(b->keys + i));
+    __m128i less = _mm_cmplt_epi32(keys, target);
+    cnt += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(less)));
+  }
+#else
+  for (int i = 0; i < BKTREE_BUCKET_CAP; i++)
+  {
+    cnt += b->keys[i] < key;
+  }
+#endif
+
+  return cnt;
+}
+
+/**
+ * @brief key가 들어있거나 들어가야 할 버킷을 찾는 함수
+ *
+ * 버킷의 index key는 버킷의 최소값이므로, index key가 key 이하인 마지막 버킷을 찾는다.
+ *
+ * @param t 대상 트리
+ * @param key 찾는 key 값
+ * @return bucket_t* 해당 버킷. key가 모든 버킷의 최소값보다 작으면 NULL
+ */
+bucket_t *find_bucket(const bktree *t, const key_t key)
+{
+  const rbtree *index = t->index;
+  node_t *cur = index->root;
+  node_t *found = NULL;
+
+  while (cur != index->nil)
+  {
+    if (cur->key <= key)
+    {
+      found = cur;
+      cur = cur->right;
+    }
+    else
+    {
+      cur = cur->left;
+    }
+  }
+
+  return (bucket_t *)found;
+}
+
+/**
+ * @brief index의 서브트리에 연결된 버킷들을 후위 순회로 해제하는 재귀함수
+ *
+ * @param index 버킷들의 index 트리
+ * @param node 서브트리의 루트
+ */
+void free_buckets(rbtree *index, node_t *node)
+{
+  if (node == index->nil)
+    return;
+
+  free_buckets(index, node->left);
+  free_buckets(index, node->right);
+  free((bucket_t *)node);
+}
+
+/**
+ * @brief 가득 찬 버킷의 뒤쪽 절반을 새 버킷으로 옮기고 index의 바로 다음 위치에 연결하는 함수
+ *
+ * @param t 대상 트리
+ * @param b 나눌 버킷
+ * @return bucket_t* 새 버킷. 할당에 실패하면 NULL
+ */
+bucket_t *split_bucket(bktree *t, bucket_t *b)
+{
+  const int half = BKTREE_BUCKET_CAP / 2;
+  bucket_t *next = new_bucket();
+  if (next == NULL)
+  {
+    return NULL;
+  }
+
+  memcpy(next->keys, b->keys + half, (BKTREE_BUCKET_CAP - half) * sizeof(key_t));
+  next->len = BKTREE_BUCKET_CAP - half;
+  for (int i = half; i < BKTREE_BUCKET_CAP; i++)
+  {
+    b->keys[i] = INT_MAX;
+  }
+  b->len = half;
+
+  // 같은 key가 여러 버킷에 걸칠 수 있으므로 key 비교 대신 위치를 지정해서 연결
+  next->node.key = next->keys[0];
+  rbtree_link_after(t->index, &b->node, &next->node);
+  return next;
+}
+
+/**
+ * @brief 버킷이 너무 비었으면 다음 버킷의 key들을 합치는 함수
+ *
+ * @param t 대상 트리
+ * @param b 합칠 기준 버킷
+ */
+void merge_bucket(bktree *t, bucket_t *b)
+{
+  if (b->len >= BKTREE_BUCKET_CAP / 4)
+  {
+    return;
+  }
+
+  bucket_t *next = (bucket_t *)rbtree_next(t->index, &b->node);
+  if (next == NULL || b->len + next->len > BKTREE_BUCKET_CAP * 3 / 4)
+  {
+    return;
+  }
+
+  memcpy(b->keys + b->len, next->keys, next->len * sizeof(key_t));
+  b->len += next->len;
+  rbtree_unlink(t->index, &next->node);
+  free(next);
+}
+
+/////////////////////////////////////////
+
+/**
+ * @brief 정렬된 key 버킷을 리프로 가지는 트리를 생성하는 함수
+ *
+ * 레드블랙 트리의 노드 하나가 최대 BKTREE_BUCKET_CAP개의 key를 담는 버킷을 가리키므로
+ * 트리의 높이와 key당 포인터 오버헤드가 rbtree보다 크게 줄어든다.
+ *
+ * @return bktree*
+ */
+bktree *new_bktree(void)
+{
+  bktree *t = (bktree *)calloc(1, sizeof(bktree));
+  t->index = new_rbtree();
+  return t;
+}
+
+/**
+ * @brief 트리를 삭제하고 관련된 모든 메모리를 해제하는 함수
+ *
+ * @param t 대상 트리
+ */
+void delete_bktree(bktree *t)
+{
+  // 버킷은 bktree가 할당한 메모리이므로 직접 해제하고, 비운 index만 delete_rbtree로 삭제
+  free_buckets(t->index, t->index->root);
+  t->index->root = t->index->nil;
+  delete_rbtree(t->index);
+  free(t);
+}
+
+/**
+ * @brief 트리에 key를 추가하는 함수 (multiset)
+ *
+ * @param t 대상 트리
+ * @param key 삽입하고자 하는 key 값
+ * @return int 성공하면 0, 메모리 할당에 실패하면 -1
+ */
+int bktree_insert(bktree *t, const key_t key)
+{
+  bucket_t *b = find_bucket(t, key);
+
+  if (b == NULL)
+  {
+    if (t->index->root == t->index->nil) // 첫 버킷
+    {
+      b = new_bucket();
+      if (b == NULL)
+      {
+        return -1;
+      }
+      b->node.key = key;
+      rbtree_link_after(t->index, NULL, &b->node);
+    }
+    else // 모든 값보다 작으면 첫 버킷에 추가
+    {
+      b = (bucket_t *)rbtree_min(t->index);
+    }
+  }
+
+  if (b->len == BKTREE_BUCKET_CAP)
+  {
+    bucket_t *next = split_bucket(t, b);
+    if (next == NULL)
+    {
+      return -1;
+    }
+    if (key > next->keys[0])
+    {
+      b = next;
+    }
+  }
+
+  int pos = bucket_lower_bound(b, key);
+  memmove(b->keys + pos + 1, b->keys + pos, (b->len - pos) * sizeof(key_t));
+  b->keys[pos] = key;
+  b->len++;
+  b->node.key = b->keys[0];
+
+  t->size++;
+  return 0;
+}
+
+/**
+ * @brief 트리에 key가 있는지 찾는 함수
+ *
+ * @param t 검색할 트리
+ * @param key 찾고자 하는 key 값
+ * @return int 있으면 1, 없으면 0
+ */
+int bktree_find(const bktree *t, const key_t key)
+{
+  bucket_t *b = find_bucket(t, key);
+  if (b == NULL)
+  {
+    return 0;
+  }
+
+  int pos = bucket_lower_bound(b, key);
+  return pos < b->len && b->keys[pos] == key;
+}
+
+/**
+ * @brief 트리의 최소값 찾기
+ *
+ * @param t 대상 트리
+ * @param key 최소값을 저장할 위치
+ * @return int 성공하면 0, 트리가 비어있으면 -1
+ */
+int bktree_min(const bktree *t, key_t *key)
+{
+  if (t->size == 0)
+  {
+    return -1;
+  }
+
+  bucket_t *b = (bucket_t *)rbtree_min(t->index);
+  *key = b->keys[0];
+  return 0;
+}
+
+/**
+ * @brief 트리의 최대값 찾기
+ *
+ * @param t 대상 트리
+ * @param key 최대값을 저장할 위치
+ * @return int 성공하면 0, 트리가 비어있으면 -1
+ */
+int bktree_max(const bktree *t, key_t *key)
+{
+  if (t->size == 0)
+  {
+    return -1;
+  }
+
+  bucket_t *b = (bucket_t *)rbtree_max(t->index);
+  *key = b->keys[b->len - 1];
+  return 0;
+}
+
+/**
+ * @brief 트리에서 key 하나를 삭제하는 함수
+ *
+ * 버킷이 비면 index에서 떼어내고, 너무 비면 다음 버킷과 합친다.
+ *
+ * @param t 대상 트리
+ * @param key 삭제할 key 값
+ * @return int 삭제했으면 0, key가 없으면 -1
+ */
+int bktree_erase(bktree *t, const key_t key)
+{
+  bucket_t *b = find_bucket(t, key);
+  if (b == NULL)
+  {
+    return -1;
+  }
+
+  int pos = bucket_lower_bound(b, key);
+  if (pos >= b->len || b->keys[pos] != key)
+  {
+    return -1;
+  }
+
+  memmove(b->keys + pos, b->keys + pos + 1, (b->len - pos - 1) * sizeof(key_t));
+  b->len--;
+  b->keys[b->len] = INT_MAX;
+  t->size--;
+
+  if (b->len == 0)
+  {
+    rbtree_unlink(t->index, &b->node);
+    free(b);
+    return 0;
+  }
+
+  // 최소값이 바뀌어도 이전/다음 버킷 사이의 순서는 그대로이므로 key만 갱신
+  b->node.key = b->keys[0];
+  merge_bucket(t, b);
+  return 0;
+}
+
+/**
+ * @brief 트리에 저장된 값을 크기 n의 배열에 순서대로 저장하는 함수
+ *
+ * @param t 대상 트리
+ * @param arr 값을 저장할 배열
+ * @param n 배열의 크기
+ * @return int
+ */
+int bktree_to_array(const bktree *t, key_t *arr, const size_t n)
+{
+  size_t index = 0;
+  node_t *node = (t->size == 0) ? NULL : rbtree_min(t->index);
+
+  while (node != NULL && index < n)
+  {
+    bucket_t *b = (bucket_t *)node;
+    size_t len = (size_t)b->len < n - index ? (size_t)b->len : n - index;
+
+    memcpy(arr + index, b->keys, len * sizeof(key_t));
+    index += len;
+    node = rbtree_next(t->index, node);
+  }
+
+  return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef _BKTREE_H_
+#define _BKTREE_H_
+
+#include "rbtree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 16 keys = 64 bytes, one cache line of keys per bucket
+#define BKTREE_BUCKET_CAP 16
+
+typedef struct bucket_t {
+  node_t node;  // index entry, key is the smallest key in the bucket
+  int len;
+  key_t keys[BKTREE_BUCKET_CAP];
+} bucket_t;
+
+typedef struct {
+  rbtree *index;  // red-black tree over the buckets
+  size_t size;
+} bktree;
+
+bktree *new_bktree(void);
+void delete_bktree(bktree *);
+
+int bktree_insert(bktree *, const key_t);
+int bktree_find(const bktree *, const key_t);
+int bktree_min(const bktree *, key_t *);
+int bktree_max(const bktree *, key_t *);
+int bktree_erase(bktree *, const key_t);
+
+int bktree_to_array(const bktree *, key_t *, const size_t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // _BKTREE_H_
@@ -1,5 +1,63 @@
 #include "rbtree.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BATCH 256
+#define LOOKUPS (1 << 20)
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// compare a loop of rbtree_find calls against rbtree_find_batch on one size
+static void bench_find(const size_t n) {
+  rbtree *t = new_rbtree();
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, rand());
+  }
+
+  key_t *keys = calloc(LOOKUPS, sizeof(key_t));
+  for (size_t i = 0; i < LOOKUPS; i++) {
+    keys[i] = rand();
+  }
+  node_t **nodes = calloc(BATCH, sizeof(node_t *));
+  size_t hits = 0;
+
+  double start = now_ns();
+  for (size_t i = 0; i < LOOKUPS; i++) {
+    hits += rbtree_find(t, keys[i]) != NULL;
+  }
+  const double loop_ns = (now_ns() - start) / LOOKUPS;
+
+  start = now_ns();
+  for (size_t i = 0; i < LOOKUPS; i += BATCH) {
+    rbtree_find_batch(t, keys + i, BATCH, nodes);
+    for (size_t j = 0; j < BATCH; j++) {
+      hits -= nodes[j] != NULL;
+    }
+  }
+  const double batch_ns = (now_ns() - start) / LOOKUPS;
+
+  printf("%10zu %12.1f %12.1f %8.2fx%s\n", n, loop_ns, batch_ns,
+         loop_ns / batch_ns, hits ? "  (mismatch!)" : "");
+
+  free(nodes);
+  free(keys);
+  delete_rbtree(t);
+}
+
 int main(int argc, char *argv[]) {
+  const size_t max_n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1 << 22;
 
-}
\ No newline at end of file
+  srand(1);
+  printf("%10s %12s %12s %9s\n", "nodes", "find ns/op", "batch ns/op",
+         "speedup");
+  for (size_t n = 1 << 10; n <= max_n; n <<= 2) {
+    bench_find(n);
+  }
+  return 0;
+}
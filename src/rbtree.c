@@ -1,9 +1,91 @@
 
 #include "rbtree.h"
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdlib.h>
+#include <string.h>
+
+// rbtree_find_batch가 한 번에 함께 진행시키는 탐색의 개수
+#define FIND_BATCH_GROUP 16
+
+// 해시 인덱스의 최소 슬롯 수 (2의 거듭제곱)
+#define HASH_MIN_CAP 16
+
+// 쓰기 버퍼가 가득 찼을 때 한 번의 삽입에서 트리로 옮기는 key의 개수
+#define WBUF_MERGE_STEP 8
+
+// 탑다운 연산이 한 번에 잠글 수 있는 노드의 최대 개수
+#define LOCK_SET_MAX 8
+
+/**
+ * @brief key -> node 해시 인덱스 (open addressing, linear probing)
+ *
+ * multiset이므로 같은 key의 노드마다 엔트리가 하나씩 있고, 엔트리는 (key, node) 쌍으로 구분한다.
+ * 빈 슬롯은 node가 NULL이다.
+ */
+typedef struct rbtree_hash
+{
+  size_t cap; // 슬롯 수 (2의 거듭제곱)
+  size_t len; // 사용 중인 슬롯 수
+  struct hash_entry
+  {
+    key_t key;
+    node_t *node;
+  } *slots;
+} rbtree_hash;
+
+/**
+ * @brief 아직 트리에 합쳐지지 않은 삽입들을 모아두는 정렬된 쓰기 버퍼
+ *
+ * keys[start, start + len)이 오름차순으로 정렬되어 있다.
+ * 앞에서 꺼낼 때는 start만 옮기고, 뒤에서 트리로 합칠 때는 len만 줄이므로 양 끝의 제거가 O(1)이다.
+ */
+typedef struct rbtree_wbuf
+{
+  size_t cap;
+  size_t start;
+  size_t len;
+  key_t keys[];
+} rbtree_wbuf;
 
 /////////////////////////////////////////
 
+#ifdef RBTREE_AUGMENT
+/**
+ * @brief 자식들의 summary로부터 노드 x의 summary를 다시 계산하는 함수
+ *
+ * @param x 대상 노드 (nil이 아니어야 함)
+ */
+void update_summary(node_t *x)
+{
+  x->summary = rbtree_summary_combine(
+      rbtree_summary_combine(x->left->summary, rbtree_summary_of(x->key, x->count)),
+      x->right->summary);
+}
+
+/**
+ * @brief 노드 x부터 루트까지 summary를 다시 계산하는 함수
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param x 시작 노드
+ */
+void update_path(rbtree *t, node_t *x)
+{
+  while (x != t->nil)
+  {
+    update_summary(x);
+    x = x->parent;
+  }
+}
+
+#define UPDATE_SUMMARY(x) update_summary(x)
+#define UPDATE_PATH(t, x) update_path(t, x)
+#else
+// augmentation이 없으면 summary 갱신 코드는 아무것도 생성하지 않음
+#define UPDATE_SUMMARY(x) ((void)0)
+#define UPDATE_PATH(t, x) ((void)0)
+#endif
+
 /**
  * @brief 주어진 노드 x를 기준으로 트리를 왼쪽 회전시키는 함수
  *
@@ -41,6 +123,10 @@ void left_rotate(rbtree *t, node_t *x)
   // step3. x와 y의 관계 역전시키자
   y->left = x;   // y의 왼쪽 자식을 x로 변경
   x->parent = y; // x의 부모를 y로 변경
+
+  // 서브트리가 바뀐 x, y의 summary 갱신 (아래쪽인 x부터)
+  UPDATE_SUMMARY(x);
+  UPDATE_SUMMARY(y);
 }
 
 /**
@@ -80,6 +166,9 @@ void right_rotate(rbtree *t, node_t *x)
   // step3. x와 y의 관계 역전시키자
   y->right = x;
   x->parent = y;
+
+  UPDATE_SUMMARY(x);
+  UPDATE_SUMMARY(y);
 }
 
 /**
@@ -163,9 +252,12 @@ void erase_fixup(rbtree *t, node_t *target)
 {
   while (1)
   {
-    // target이 root면 종료
+    // target이 root면 Black으로 칠하고 종료 (#2)
     if (target == t->root)
+    {
+      target->color = RBTREE_BLACK;
       return;
+    }
 
     // target이 red_and_black인 경우
     if (target->color == RBTREE_RED)
@@ -270,40 +362,257 @@ void transplant(rbtree *t, node_t *x, node_t *y)
   y->parent = x->parent;
 }
 
+// 모든 트리의 메모리 사용량 합계 (여러 스레드의 트리가 함께 갱신하므로 atomic)
+static atomic_size_t registry_trees;
+static atomic_size_t registry_bytes;
+static atomic_size_t registry_peak;
+static atomic_size_t registry_pending;
+
+/**
+ * @brief 할당/해제한 메모리 크기를 전역 합계와 최대 사용량에 반영하는 함수
+ *
+ * @param delta 늘어난 바이트 수 (해제했으면 음수)
+ */
+void registry_add(const ptrdiff_t delta)
+{
+  size_t total = atomic_fetch_add(&registry_bytes, (size_t)delta) + (size_t)delta;
+
+  size_t peak = atomic_load(&registry_peak);
+  while (delta > 0 && total > peak && !atomic_compare_exchange_weak(&registry_peak, &peak, total))
+  {
+  }
+}
+
 /**
- * @brief 레드블랙 트리의 노드들의 메모리를 반환하는 재귀함수
+ * @brief 트리가 할당/해제한 메모리 크기를 트리와 전역 합계에 반영하는 함수
  *
  * @param t 대상이 되는 레드블랙 트리
+ * @param delta 늘어난 바이트 수 (해제했으면 음수)
  */
-void free_rbtree(rbtree *t)
+void account(rbtree *t, const ptrdiff_t delta)
 {
-  // 트리가 비어있다면 함수 종료
-  if (t->root == t->nil)
+  t->bytes += (size_t)delta;
+  registry_add(delta);
+}
+
+/**
+ * @brief 여러 스레드가 동시에 수정하는 트리의 메모리 크기를 반영하는 함수 (concurrent 연산용)
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param delta 늘어난 바이트 수 (해제했으면 음수)
+ */
+void account_shared(rbtree *t, const ptrdiff_t delta)
+{
+  __atomic_fetch_add(&t->bytes, (size_t)delta, __ATOMIC_RELAXED);
+  registry_add(delta);
+}
+
+/**
+ * @brief 노드의 메모리를 반환하는 함수
+ *
+ * rbtree_compact가 만든 연속 메모리 블록 안의 노드는 개별적으로 해제할 수 없으므로
+ * 재사용 목록에 반납하고, 블록은 다음 compact나 트리 삭제 때 한 번에 해제한다.
+ *
+ * @param t 노드가 속한 레드블랙 트리
+ * @param node 반환할 노드
+ */
+void free_node(rbtree *t, node_t *node)
+{
+  t->nodes--;
+  if (t->block != NULL && node >= t->block && node < t->block + t->block_len)
   {
+    node->right = t->free_list;
+    t->free_list = node;
     return;
   }
 
-  // 서브트리를 위한 새로운 레드블랙 트리 생성
-  rbtree *subtree = (rbtree *)calloc(1, sizeof(rbtree));
-  subtree->nil = t->nil;
+  free(node);
+  account(t, -(ptrdiff_t)sizeof(node_t));
+}
 
-  // 왼쪽/오른쪽 서브트리가 있으면 재귀적으로 메모리 반환
+/**
+ * @brief 재사용 목록의 노드들의 메모리를 반환하는 함수 (블록 안의 노드는 블록과 함께 해제됨)
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ */
+void release_free_list(rbtree *t)
+{
+  node_t *node = t->free_list;
+  t->free_list = NULL;
 
-  if (t->root->left != t->nil)
+  while (node != NULL)
   {
-    subtree->root = t->root->left;
-    free_rbtree(subtree);
+    node_t *next = node->right;
+    if (t->block == NULL || node < t->block || node >= t->block + t->block_len)
+    {
+      free(node);
+      account(t, -(ptrdiff_t)sizeof(node_t));
+    }
+    node = next;
   }
+}
 
-  if (t->root->right != t->nil)
+/**
+ * @brief 트리에서 떼어낸 뒤 아직 메모리를 반환하지 않은 노드들
+ *
+ * 남은 노드들은 parent 포인터로 연결된 스택에 있고, 스택에서 하나를 꺼낼 때마다 그 자식들을 넣는다.
+ * 재귀나 추가 할당 없이 한 번에 정해진 개수만큼만 반환할 수 있다.
+ */
+typedef struct reclaim_t
+{
+  node_t *stack;     // 아직 반환하지 않은 서브트리들의 루트
+  node_t *free_list; // 재사용 목록에 남아있던 노드들
+  node_t *nil;
+  node_t *block;
+  size_t block_len;
+  size_t bytes; // 트리가 쥐고 있던 메모리 (반환이 끝나면 전역 합계에서 뺌)
+  struct reclaim_t *next;
+} reclaim_t;
+
+// delete_rbtree_deferred로 넘겨진 뒤 아직 반환이 끝나지 않은 트리들
+static reclaim_t *reclaim_list = NULL;
+
+/**
+ * @brief 트리의 노드들을 reclaim_t로 넘기는 함수. 노드 수와 관계없이 O(1)이다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param r 노드들을 넘겨받을 reclaim_t
+ */
+void detach_nodes(rbtree *t, reclaim_t *r)
+{
+  r->stack = NULL;
+  if (t->root != t->nil)
   {
-    subtree->root = t->root->right;
-    free_rbtree(subtree);
+    r->stack = t->root;
+    r->stack->parent = NULL;
   }
+  r->free_list = t->free_list;
+  r->nil = t->nil;
+  r->block = t->block;
+  r->block_len = t->block_len;
+  r->bytes = t->bytes;
+  r->next = NULL;
+}
 
-  // 루트 노드와 서브트리를 위해 할당한 메모리 반환
-  free(t->root);
-  free(subtree);
+/**
+ * @brief reclaim_t에 남은 노드들의 메모리를 최대 budget개 반환하는 함수
+ *
+ * 모든 노드를 반환하면 연속 메모리 블록과 nil 노드까지 해제한다.
+ *
+ * @param r 대상 reclaim_t
+ * @param budget 반환할 최대 노드 개수
+ * @return size_t 실제로 처리한 노드 개수. budget보다 작으면 r의 반환이 끝난 것
+ */
+size_t reclaim_nodes(reclaim_t *r, const size_t budget)
+{
+  size_t done = 0;
+
+  while (done < budget && r->stack != NULL)
+  {
+    node_t *x = r->stack;
+    r->stack = x->parent;
+
+    // 자식들을 스택에 넣은 뒤 x 반환
+    if (x->left != r->nil)
+    {
+      x->left->parent = r->stack;
+      r->stack = x->left;
+    }
+    if (x->right != r->nil)
+    {
+      x->right->parent = r->stack;
+      r->stack = x->right;
+    }
+    if (r->block == NULL || x < r->block || x >= r->block + r->block_len)
+    {
+      free(x);
+    }
+    done++;
+  }
+
+  while (done < budget && r->free_list != NULL)
+  {
+    node_t *x = r->free_list;
+    r->free_list = x->right;
+    if (r->block == NULL || x < r->block || x >= r->block + r->block_len)
+    {
+      free(x);
+    }
+    done++;
+  }
+
+  if (done < budget)
+  {
+    free(r->block);
+    free(r->nil);
+    r->block = r->nil = NULL;
+  }
+  return done;
+}
+
+/**
+ * @brief node를 루트로 하는 서브트리의 노드 개수를 세는 재귀함수
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param node 서브트리의 루트
+ * @return size_t 노드 개수
+ */
+size_t count_nodes(const rbtree *t, const node_t *node)
+{
+  if (node == t->nil)
+    return 0;
+
+  return 1 + count_nodes(t, node->left) + count_nodes(t, node->right);
+}
+
+/**
+ * @brief 비어있지 않은 트리의 노드들을 BFS 순서로 block에 복사하는 함수
+ *
+ * 블록 자체를 BFS 큐로 사용한다: block[i]의 자식들을 블록의 끝에 복사하면서 포인터를 고친다.
+ *
+ * @param src 복사할 레드블랙 트리
+ * @param block 노드 개수만큼 할당된 메모리
+ * @param nil 복사본에서 사용할 nil 노드
+ * @param owner NULL이 아니면 복사한 원본 노드를 owner 트리에서 해제 (compact)
+ */
+void copy_level_order(const rbtree *src, node_t *block, node_t *nil, rbtree *owner)
+{
+  block[0] = *src->root;
+  if (owner != NULL)
+    free_node(owner, src->root);
+  block[0].parent = nil;
+
+  size_t tail = 1;
+  for (size_t i = 0; i < tail; i++)
+  {
+    node_t *x = &block[i];
+
+    if (x->left != src->nil)
+    {
+      block[tail] = *x->left;
+      if (owner != NULL)
+        free_node(owner, x->left);
+      block[tail].parent = x;
+      x->left = &block[tail++];
+    }
+    else
+    {
+      x->left = nil;
+    }
+
+    if (x->right != src->nil)
+    {
+      block[tail] = *x->right;
+      if (owner != NULL)
+        free_node(owner, x->right);
+      block[tail].parent = x;
+      x->right = &block[tail++];
+    }
+    else
+    {
+      x->right = nil;
+    }
+  }
 }
 
 /**
@@ -331,11 +640,17 @@ void inorder(const rbtree *t, key_t *arr, int *index, const size_t n)
   subtree->root = t->root->left;
   inorder(subtree, arr, index, n);
 
-  // 루트 순회
-  if (*index == n)
-    return;
-  arr[*index] = t->root->key;
-  *index += 1;
+  // 루트 순회 (counted 모드에서는 count만큼 반복해서 추가)
+  for (unsigned int i = 0; i < t->root->count; i++)
+  {
+    if (*index == n)
+    {
+      free(subtree);
+      return;
+    }
+    arr[*index] = t->root->key;
+    *index += 1;
+  }
 
   // 오른쪽 서브트리 재귀적으로 순회
   subtree->nil = t->nil;
@@ -345,233 +660,2389 @@ void inorder(const rbtree *t, key_t *arr, int *index, const size_t n)
   free(subtree);
 }
 
-/////////////////////////////////////////
-
 /**
- * @brief 레드블랙 트리를 생성하는 함수
+ * @brief 삽입할 노드의 메모리를 준비하는 함수. 반납된 노드가 있으면 재사용한다.
  *
- * @return rbtree*
+ * @param t 노드를 삽입할 레드블랙 트리
+ * @return node_t* 필드가 초기화되지 않은 노드
  */
-rbtree *new_rbtree(void)
+node_t *alloc_node(rbtree *t)
 {
-  rbtree *p = (rbtree *)calloc(1, sizeof(rbtree));
+  node_t *node = t->free_list;
 
-  node_t *NIL = (node_t *)calloc(1, sizeof(node_t));
-  NIL->color = RBTREE_BLACK;
-  NIL->key = -1;
-  NIL->left = NULL;
-  NIL->parent = NULL;
-  NIL->right = NULL;
+  if (node == NULL)
+  {
+    node = (node_t *)calloc(1, sizeof(node_t));
+    if (node == NULL)
+      return NULL;
+    account(t, sizeof(node_t));
+  }
+  else
+  {
+    t->free_list = node->right;
+  }
 
-  p->nil = NIL;
-  p->root = NIL;
+  t->nodes++;
+  return node;
+}
 
-  return p;
+/**
+ * @brief 트리에서 떼어낸 노드를 다음 삽입에서 재사용하도록 반납하는 함수
+ *
+ * @param t 노드가 속해 있던 레드블랙 트리
+ * @param node 반납할 노드
+ */
+void recycle_node(rbtree *t, node_t *node)
+{
+  t->nodes--;
+  node->right = t->free_list;
+  t->free_list = node;
 }
 
 /**
- * @brief 레드블랙 트리를 삭제하고 관련된 모든 메모리를 해제하는 함수
+ * @brief 자식이 하나 이하인 노드 x를 트리에서 떼어내는 함수
+ *
+ * 최소/최대 노드는 항상 한쪽 자식이 없으므로 후임자 탐색 없이 바로 떼어낼 수 있다.
  *
  * @param t 대상이 되는 레드블랙 트리
+ * @param x 떼어낼 노드
+ * @param child x의 유일한 자식 (없으면 nil)
  */
-void delete_rbtree(rbtree *t)
+void unlink_edge(rbtree *t, node_t *x, node_t *child)
 {
-  // 트리의 모든 노드를 순회하며 각 노드에 대한 메모리 해제
-  free_rbtree(t);
+  transplant(t, x, child);
+  UPDATE_PATH(t, child->parent);
 
-  // 트리의 nil 노드에 대한 메모리 해제
-  free(t->nil);
-
-  // 트리 자체를 위해 할당된 메모리 해제
-  free(t);
+  if (x->color == RBTREE_BLACK)
+  {
+    erase_fixup(t, child);
+  }
 }
 
 /**
- * @brief 레드블랙 트리에 주어진 key 값을 가진 노드를 삽입하는 함수
+ * @brief 중위 순회 기준으로 x 바로 다음 노드를 찾는 함수
  *
- * @param t key를 삽입할 레드블랙 트리
- * @param key 삽입하고자 하는 key 값
- * @return node_t* 삽입한 노드 반환
+ * @param t 대상이 되는 레드블랙 트리
+ * @param x 기준 노드
+ * @return node_t* 다음 노드. 없으면 nil
  */
-node_t *rbtree_insert(rbtree *t, const key_t key)
+node_t *successor(const rbtree *t, node_t *x)
 {
-  // 삽입할 노드를 위한 메모리 할당
-  node_t *new_node = (node_t *)calloc(1, sizeof(node_t));
-  new_node->key = key;
-  new_node->color = RBTREE_RED;
-  new_node->left = t->nil;
-  new_node->right = t->nil;
-
-  node_t *parent = t->nil; // 삽입하는 노드의 부모가 될 노드
-  node_t *cur = t->root;   // 노드를 삽입할 위치
-
-  // 노드를 삽입할 위치 찾기
-  while (cur != t->nil)
+  if (x->right != t->nil)
   {
-    parent = cur;
-    if (cur->key >= key)
-    {
-      cur = cur->left;
-    }
-    else
+    x = x->right;
+    while (x->left != t->nil)
     {
-      cur = cur->right;
+      x = x->left;
     }
+    return x;
   }
 
-  // 삽입할 노드와 부모 연결시키기
-  new_node->parent = parent;
-
-  if (parent == t->nil)
+  // 오른쪽 서브트리가 없으면 x가 왼쪽 서브트리에 속하는 첫 조상
+  node_t *parent = x->parent;
+  while (parent != t->nil && x == parent->right)
   {
-    t->root = new_node;
+    x = parent;
+    parent = parent->parent;
   }
-  else if (parent->key >= key)
+  return parent;
+}
+
+/**
+ * @brief 중위 순회 기준으로 x 바로 이전 노드를 찾는 함수
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param x 기준 노드
+ * @return node_t* 이전 노드. 없으면 nil
+ */
+node_t *predecessor(const rbtree *t, node_t *x)
+{
+  if (x->left != t->nil)
   {
-    parent->left = new_node;
+    x = x->left;
+    while (x->right != t->nil)
+    {
+      x = x->right;
+    }
+    return x;
   }
-  else
+
+  node_t *parent = x->parent;
+  while (parent != t->nil && x == parent->left)
   {
-    parent->right = new_node;
+    x = parent;
+    parent = parent->parent;
   }
-
-  // 삽입 후 재조정
-  insert_fixup(t, new_node);
-  return new_node;
+  return parent;
 }
 
 /**
- * @brief 레드블랙 트리에서 주어진 key 값을 찾는 함수
+ * @brief 노드 z를 해제하지 않고 트리에서 떼어내는 함수
  *
- * @param t 검색할 레드블랙 트리
- * @param key 찾고자 하는 key 값
- * @return node_t* key 값에 해당하는 노드 반환. 만약 key 값이 트리에 없다면 NULL 반환
+ * rbtree_erase와 달리 후임자의 key를 z로 복사하지 않고 후임자 노드 자체를 z의 자리로 옮기므로
+ * 트리에 남아있는 다른 노드들의 포인터와 key가 그대로 유지된다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param z 떼어낼 노드
  */
-node_t *rbtree_find(const rbtree *t, const key_t key)
+void unlink_node(rbtree *t, node_t *z)
 {
-  node_t *current = t->root;
+  node_t *y = z; // 트리에서 실제로 빠지는 위치의 노드
+  color_t del_color = y->color;
+  node_t *replaced;
 
-  // key 값에 해당하는 노드 찾기
-  while (current != t->nil)
+  if (z->left == t->nil)
   {
-    if (current->key == key)
+    replaced = z->right;
+    transplant(t, z, z->right);
+  }
+  else if (z->right == t->nil)
+  {
+    replaced = z->left;
+    transplant(t, z, z->left);
+  }
+  else
+  {
+    // 후임자 y를 z의 자리로 옮기기
+    y = z->right;
+    while (y->left != t->nil)
     {
-      return current;
+      y = y->left;
     }
-    else if (current->key > key)
+    del_color = y->color;
+    replaced = y->right;
+
+    if (y->parent == z)
     {
-      current = current->left;
+      replaced->parent = y;
     }
     else
     {
-      current = current->right;
+      transplant(t, y, y->right);
+      y->right = z->right;
+      y->right->parent = y;
     }
+
+    transplant(t, z, y);
+    y->left = z->left;
+    y->left->parent = y;
+    y->color = z->color;
   }
 
-  // 존재하지 않으면 NULL 반환
-  return NULL;
+  // replaced의 부모부터 루트까지가 서브트리가 바뀐 노드들
+  UPDATE_PATH(t, replaced->parent);
+
+  if (del_color == RBTREE_BLACK)
+  {
+    erase_fixup(t, replaced);
+  }
 }
 
 /**
- * @brief 주어진 레드블랙 트리의 최소값 찾기
+ * @brief 이미 할당된 노드를 node->key 위치에 연결하고 재조정하는 함수
  *
  * @param t 대상이 되는 레드블랙 트리
- * @return node_t* 최소값을 가진 노드 반환
+ * @param node 트리에 연결할 노드 (key만 설정되어 있으면 됨)
  */
-node_t *rbtree_min(const rbtree *t)
+void link_node(rbtree *t, node_t *node)
 {
+  node_t *parent = t->nil;
+  node_t *cur = t->root;
+
+  while (cur != t->nil)
+  {
+    parent = cur;
+    cur = (cur->key >= node->key) ? cur->left : cur->right;
+  }
+
+  node->color = RBTREE_RED;
+  node->left = t->nil;
+  node->right = t->nil;
+  node->parent = parent;
+
+  if (parent == t->nil)
+  {
+    t->root = node;
+  }
+  else if (parent->key >= node->key)
+  {
+    parent->left = node;
+  }
+  else
+  {
+    parent->right = node;
+  }
+
+  UPDATE_PATH(t, node);
+  insert_fixup(t, node);
+}
+
+/**
+ * @brief key의 해시 인덱스 시작 슬롯을 구하는 함수
+ *
+ * @param h 해시 인덱스
+ * @param key 대상 key
+ * @return size_t 슬롯 번호
+ */
+size_t hash_slot(const rbtree_hash *h, const key_t key)
+{
+  unsigned int x = (unsigned int)key;
+  x ^= x >> 16;
+  x *= 0x45d9f3bu;
+  x ^= x >> 16;
+  return x & (h->cap - 1);
+}
+
+/**
+ * @brief 해시 인덱스에 (key, node) 엔트리를 넣는 함수. 크기를 늘리지 않는다.
+ *
+ * @param h 해시 인덱스 (빈 슬롯이 있어야 함)
+ * @param key 엔트리의 key
+ * @param node 엔트리의 노드
+ */
+void hash_put(rbtree_hash *h, const key_t key, node_t *node)
+{
+  size_t i = hash_slot(h, key);
+  while (h->slots[i].node != NULL)
+  {
+    i = (i + 1) & (h->cap - 1);
+  }
+  h->slots[i].key = key;
+  h->slots[i].node = node;
+  h->len++;
+}
+
+/**
+ * @brief 해시 인덱스의 슬롯 수를 cap으로 바꾸고 엔트리들을 다시 넣는 함수
+ *
+ * @param t 해시 인덱스가 켜진 레드블랙 트리
+ * @param cap 새 슬롯 수 (2의 거듭제곱)
+ * @return int 성공하면 0, 메모리 할당에 실패하면 -1 (인덱스는 그대로 유지)
+ */
+int hash_resize(rbtree *t, const size_t cap)
+{
+  rbtree_hash *h = t->hash;
+  struct hash_entry *old = h->slots;
+  size_t old_cap = h->cap;
+
+  h->slots = (struct hash_entry *)calloc(cap, sizeof(struct hash_entry));
+  if (h->slots == NULL)
+  {
+    h->slots = old;
+    return -1;
+  }
+  h->cap = cap;
+  h->len = 0;
+
+  for (size_t i = 0; i < old_cap; i++)
+  {
+    if (old[i].node != NULL)
+    {
+      hash_put(h, old[i].key, old[i].node);
+    }
+  }
+  free(old);
+  account(t, ((ptrdiff_t)cap - (ptrdiff_t)old_cap) * (ptrdiff_t)sizeof(struct hash_entry));
+  return 0;
+}
+
+/**
+ * @brief 해시 인덱스를 해제하는 함수
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ */
+void hash_free(rbtree *t)
+{
+  if (t->hash == NULL)
+    return;
+
+  account(t, -(ptrdiff_t)(sizeof(rbtree_hash) + t->hash->cap * sizeof(struct hash_entry)));
+  free(t->hash->slots);
+  free(t->hash);
+  t->hash = NULL;
+}
+
+/**
+ * @brief 트리에 새로 연결된 노드를 해시 인덱스에 추가하는 함수
+ *
+ * 슬롯을 늘리지 못하면 해시 인덱스를 끄고 트리 탐색으로 돌아간다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param node 추가할 노드
+ */
+void hash_add(rbtree *t, node_t *node)
+{
+  rbtree_hash *h = t->hash;
+  if (h == NULL)
+    return;
+
+  // load factor를 1/2 이하로 유지
+  if ((h->len + 1) * 2 > h->cap && hash_resize(t, h->cap * 2) != 0)
+  {
+    hash_free(t);
+    return;
+  }
+  hash_put(h, node->key, node);
+}
+
+/**
+ * @brief 해시 인덱스에서 (node->key, node) 엔트리의 슬롯을 찾는 함수
+ *
+ * @param h 해시 인덱스
+ * @param node 찾을 노드
+ * @return size_t 슬롯 번호 (엔트리는 항상 존재해야 함)
+ */
+size_t hash_find_entry(const rbtree_hash *h, const node_t *node)
+{
+  size_t i = hash_slot(h, node->key);
+  while (h->slots[i].node != node)
+  {
+    i = (i + 1) & (h->cap - 1);
+  }
+  return i;
+}
+
+/**
+ * @brief 트리에서 빠지는 노드를 해시 인덱스에서 지우는 함수 (node->key가 바뀌기 전에 불러야 함)
+ *
+ * tombstone 대신 뒤따르는 엔트리들을 앞으로 당겨서 탐색 길이가 늘어나지 않게 한다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param node 지울 노드
+ */
+void hash_remove(rbtree *t, node_t *node)
+{
+  rbtree_hash *h = t->hash;
+  if (h == NULL)
+    return;
+
+  const size_t mask = h->cap - 1;
+  size_t hole = hash_find_entry(h, node);
+  size_t i = hole;
+
+  while (1)
+  {
+    i = (i + 1) & mask;
+    if (h->slots[i].node == NULL)
+      break;
+
+    // i의 엔트리가 hole 위치로 당겨질 수 있는지 (시작 슬롯이 (hole, i] 밖에 있는지)
+    size_t home = hash_slot(h, h->slots[i].key);
+    if (((i - home) & mask) >= ((i - hole) & mask))
+    {
+      h->slots[hole] = h->slots[i];
+      hole = i;
+    }
+  }
+
+  h->slots[hole].node = NULL;
+  h->len--;
+}
+
+/**
+ * @brief from 노드를 가리키던 엔트리가 to 노드를 가리키도록 바꾸는 함수
+ *
+ * rbtree_erase가 후임자의 key를 삭제할 노드로 옮길 때 사용한다. from->key가 엔트리의 key이다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param from 이전 노드
+ * @param to 새 노드
+ */
+void hash_move(rbtree *t, node_t *from, node_t *to)
+{
+  if (t->hash == NULL)
+    return;
+
+  t->hash->slots[hash_find_entry(t->hash, from)].node = to;
+}
+
+/**
+ * @brief node를 루트로 하는 서브트리의 모든 노드를 해시 인덱스에 추가하는 재귀함수
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param node 서브트리의 루트
+ */
+void hash_add_subtree(rbtree *t, node_t *node)
+{
+  if (node == t->nil || t->hash == NULL)
+    return;
+
+  hash_add(t, node);
+  hash_add_subtree(t, node->left);
+  hash_add_subtree(t, node->right);
+}
+
+/**
+ * @brief x를 루트로 하는 서브트리의 최소 노드를 찾는 함수
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param x 서브트리의 루트 (nil이 아니어야 함)
+ * @return node_t* 최소 노드
+ */
+node_t *leftmost(const rbtree *t, node_t *x)
+{
+  while (x->left != t->nil)
+  {
+    x = x->left;
+  }
+  return x;
+}
+
+/**
+ * @brief x를 루트로 하는 서브트리의 최대 노드를 찾는 함수
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param x 서브트리의 루트 (nil이 아니어야 함)
+ * @return node_t* 최대 노드
+ */
+node_t *rightmost(const rbtree *t, node_t *x)
+{
+  while (x->right != t->nil)
+  {
+    x = x->right;
+  }
+  return x;
+}
+
+/**
+ * @brief 새 노드를 할당해야 하는 삽입이 메모리 예산을 넘지 않도록 정책에 따라 원소를 쫓아내는 함수
+ *
+ * 재사용 목록에 노드가 생기거나 노드 하나를 더 할당할 여유가 생길 때까지 반복한다.
+ * 트리의 노드를 모두 쫓아내도 예산을 지킬 수 없으면 트리를 건드리지 않고 거부한다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @return int 자리가 생기면 0, 쫓아낼 수 없으면 -1
+ */
+int evict_for_insert(rbtree *t)
+{
+  // 노드가 아닌 메모리(트리 자체, 해시 인덱스, 쓰기 버퍼, 재사용 목록)는 쫓아내도 줄지 않음
+  if (t->bytes - t->nodes * sizeof(node_t) + sizeof(node_t) > t->budget)
+  {
+    return -1;
+  }
+
+  while (t->free_list == NULL && t->bytes + sizeof(node_t) > t->budget)
+  {
+    node_t *victim = NULL;
+
+    if (t->root != t->nil)
+    {
+      switch (t->evict)
+      {
+      case RBTREE_EVICT_MIN:
+        victim = leftmost(t, t->root);
+        break;
+      case RBTREE_EVICT_MAX:
+        victim = rightmost(t, t->root);
+        break;
+      case RBTREE_EVICT_CALLBACK:
+        victim = (t->evict_fn != NULL) ? t->evict_fn(t, t->evict_arg) : NULL;
+        break;
+      default:
+        break;
+      }
+    }
+
+    if (victim == NULL)
+    {
+      return -1;
+    }
+    // counted 모드에서도 노드를 통째로 지워야 메모리가 생기므로 같은 key를 모두 함께 쫓아냄
+    victim->count = 1;
+    rbtree_erase(t, victim);
+  }
+  return 0;
+}
+
+/**
+ * @brief 쓰기 버퍼에서 key 이상인 첫 위치를 찾는 함수
+ *
+ * @param w 쓰기 버퍼
+ * @param key 찾는 key 값
+ * @return size_t keys[start + i] >= key 인 가장 작은 i (없으면 len)
+ */
+size_t wbuf_lower_bound(const rbtree_wbuf *w, const key_t key)
+{
+  size_t lo = 0, hi = w->len;
+  while (lo < hi)
+  {
+    size_t mid = (lo + hi) / 2;
+    if (w->keys[w->start + mid] < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/**
+ * @brief 쓰기 버퍼의 뒤쪽(큰 값)부터 최대 budget개의 key를 트리에 합치는 함수
+ *
+ * 메모리 예산 때문에 삽입이 거부되면 그 key를 버퍼에 남겨두고 멈춘다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param budget 합칠 최대 개수
+ * @return size_t 실제로 합친 개수
+ */
+size_t wbuf_merge(rbtree *t, const size_t budget)
+{
+  rbtree_wbuf *w = t->wbuf;
+  size_t merged = 0;
+
+  while (merged < budget && w->len > 0)
+  {
+    if (rbtree_insert(t, w->keys[w->start + w->len - 1]) == NULL)
+    {
+      break;
+    }
+    w->len--;
+    merged++;
+  }
+  if (w->len == 0)
+  {
+    w->start = 0;
+  }
+
+  return merged;
+}
+
+/**
+ * @brief 쓰기 버퍼의 최소값이 트리의 최소 노드 min보다 작으면 버퍼에서 꺼내는 함수
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param min 트리의 최소 노드 (비어있으면 nil)
+ * @param key 꺼낸 값을 저장할 위치
+ * @return int 버퍼에서 꺼냈으면 1, 아니면 0
+ */
+int wbuf_pop_min(rbtree *t, const node_t *min, key_t *key)
+{
+  rbtree_wbuf *w = t->wbuf;
+  if (w == NULL || w->len == 0 || (min != t->nil && w->keys[w->start] >= min->key))
+  {
+    return 0;
+  }
+
+  *key = w->keys[w->start];
+  w->start++;
+  w->len--;
+  if (w->len == 0)
+  {
+    w->start = 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief 쓰기 버퍼의 최대값이 트리의 최대 노드 max보다 크면 버퍼에서 꺼내는 함수
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param max 트리의 최대 노드 (비어있으면 nil)
+ * @param key 꺼낸 값을 저장할 위치
+ * @return int 버퍼에서 꺼냈으면 1, 아니면 0
+ */
+int wbuf_pop_max(rbtree *t, const node_t *max, key_t *key)
+{
+  rbtree_wbuf *w = t->wbuf;
+  if (w == NULL || w->len == 0 || (max != t->nil && w->keys[w->start + w->len - 1] <= max->key))
+  {
+    return 0;
+  }
+
+  w->len--;
+  *key = w->keys[w->start + w->len];
+  if (w->len == 0)
+  {
+    w->start = 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief 버퍼에 남은 key를 모두 트리에 합치는 함수
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @return int 모두 합쳤으면 0, 메모리 예산 때문에 남은 key가 있으면 -1
+ */
+int wbuf_flush(rbtree *t)
+{
+  if (t->wbuf != NULL && t->wbuf->len > 0)
+  {
+    wbuf_merge(t, t->wbuf->len);
+    return t->wbuf->len == 0 ? 0 : -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief 쓰기 버퍼의 i번째 key 하나만 트리로 옮기는 함수
+ *
+ * 읽기 연산이 필요한 key만 옮기므로 버퍼 전체를 합치는 비용을 읽기에서 치르지 않는다.
+ * 버퍼에서 빼는 쪽은 앞뒤 중 가까운 쪽을 당기므로 O(cap / 2)의 memmove로 끝난다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param i 옮길 key의 버퍼 안 위치 (keys[start + i])
+ * @return node_t* 삽입된 노드. 예산 때문에 삽입이 거부되면 NULL (key는 버퍼에 그대로 남음)
+ */
+node_t *wbuf_promote(rbtree *t, const size_t i)
+{
+  rbtree_wbuf *w = t->wbuf;
+  node_t *node = rbtree_insert(t, w->keys[w->start + i]);
+  if (node == NULL)
+    return NULL;
+
+  if (i < w->len / 2)
+  {
+    memmove(w->keys + w->start + 1, w->keys + w->start, i * sizeof(key_t));
+    w->start++;
+  }
+  else
+  {
+    memmove(w->keys + w->start + i, w->keys + w->start + i + 1, (w->len - i - 1) * sizeof(key_t));
+  }
+  w->len--;
+  if (w->len == 0)
+  {
+    w->start = 0;
+  }
+  return node;
+}
+
+/**
+ * @brief 쓰기 버퍼를 합치지 않고 해제하는 함수
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ */
+void wbuf_free(rbtree *t)
+{
+  if (t->wbuf == NULL)
+    return;
+
+  account(t, -(ptrdiff_t)(sizeof(rbtree_wbuf) + t->wbuf->cap * sizeof(key_t)));
+  free(t->wbuf);
+  t->wbuf = NULL;
+}
+
+/**
+ * @brief 노드의 spinlock을 잡는 함수
+ *
+ * node_t는 C++에서도 쓰이므로 lock은 일반 int로 두고 GCC atomic builtin으로 다룬다.
+ *
+ * @param node 잠글 노드 (nil 노드의 lock은 t->root를 보호함)
+ */
+void spin_lock(node_t *node)
+{
+  while (__atomic_exchange_n(&node->lock, 1, __ATOMIC_ACQUIRE))
+  {
+    while (__atomic_load_n(&node->lock, __ATOMIC_RELAXED))
+    {
+      sched_yield();
+    }
+  }
+}
+
+/**
+ * @brief 노드의 spinlock을 놓는 함수
+ *
+ * @param node 잠금을 풀 노드
+ */
+void spin_unlock(node_t *node)
+{
+  __atomic_store_n(&node->lock, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 탑다운 연산이 잠근 노드들의 목록
+ *
+ * concurrent가 0이면 아무것도 잠그지 않으므로 같은 코드를 단일 스레드용으로 그대로 쓸 수 있다.
+ * 노드의 자식 포인터는 그 노드의 lock이, 노드의 색은 부모의 lock이 보호한다.
+ */
+typedef struct lock_set_t
+{
+  int concurrent;
+  int len;
+  node_t *nodes[LOCK_SET_MAX];
+} lock_set_t;
+
+/**
+ * @brief 노드를 잠그고 목록에 추가하는 함수. 이미 잠근 노드면 아무것도 하지 않는다.
+ *
+ * @param s 잠금 목록
+ * @param node 잠글 노드
+ */
+void lock_add(lock_set_t *s, node_t *node)
+{
+  if (!s->concurrent)
+    return;
+
+  for (int i = 0; i < s->len; i++)
+  {
+    if (s->nodes[i] == node)
+      return;
+  }
+  spin_lock(node);
+  s->nodes[s->len++] = node;
+}
+
+/**
+ * @brief a, b, c, d 이외의 노드들의 잠금을 푸는 함수 (NULL은 무시)
+ *
+ * @param s 잠금 목록
+ */
+void lock_keep(lock_set_t *s, const node_t *a, const node_t *b, const node_t *c, const node_t *d)
+{
+  int len = 0;
+  for (int i = 0; i < s->len; i++)
+  {
+    node_t *node = s->nodes[i];
+    if (node == a || node == b || node == c || node == d)
+    {
+      s->nodes[len++] = node;
+    }
+    else
+    {
+      spin_unlock(node);
+    }
+  }
+  s->len = len;
+}
+
+/**
+ * @brief 목록의 모든 잠금을 푸는 함수
+ *
+ * @param s 잠금 목록
+ */
+void lock_release(lock_set_t *s)
+{
+  lock_keep(s, NULL, NULL, NULL, NULL);
+}
+
+/**
+ * @brief 탑다운 삽입에서 red인 x와 그 부모 p가 연속으로 red일 때 조부모 g에서 회전하는 함수
+ *
+ * x가 안쪽 손자이면 p에서 먼저 회전한다 (double rotation). g의 부모까지 잠겨 있어야 한다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param x red 노드
+ * @param p x의 부모 (red)
+ * @param g p의 부모 (black)
+ * @return node_t* 회전 후 g의 자리에 올라온 노드 (black)
+ */
+node_t *topdown_rotate(rbtree *t, node_t *x, node_t *p, node_t *g)
+{
+  if (p == g->left)
+  {
+    if (x == p->right)
+    {
+      left_rotate(t, p);
+      p = x;
+    }
+    right_rotate(t, g);
+  }
+  else
+  {
+    if (x == p->left)
+    {
+      right_rotate(t, p);
+      p = x;
+    }
+    left_rotate(t, g);
+  }
+
+  p->color = RBTREE_BLACK;
+  g->color = RBTREE_RED;
+  return p;
+}
+
+/**
+ * @brief 내려가면서 재조정하는 한 번의 경로로 key를 삽입하는 함수
+ *
+ * 두 자식이 모두 red인 노드를 만나면 색을 뒤집고, 그 때문에 red가 연속되면 바로 위에서 회전한다.
+ * 회전은 현재 노드의 조부모에서만 일어나므로 경로 위의 최근 4개 노드(루트 위는 nil)만 잠그고 있으면 된다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param key 삽입할 key
+ * @param concurrent 0이 아니면 노드를 잠그며 내려가고, 해시 인덱스/재사용 목록/예산을 사용하지 않음
+ * @return node_t* 삽입한 노드 (counted 모드에서 같은 key가 있으면 그 노드), 할당에 실패하거나 예산 안에 자리를 만들 수 없으면 NULL
+ */
+node_t *insert_topdown(rbtree *t, const key_t key, const int concurrent)
+{
+  lock_set_t locks = {concurrent, 0, {NULL}};
+  node_t *great = NULL, *g = NULL, *p = t->nil;
+
+  lock_add(&locks, t->nil);
+  node_t *x = t->root;
+  if (x != t->nil)
+    lock_add(&locks, x);
+
+  while (x != t->nil)
+  {
+    if (t->counted && x->key == key)
+    {
+      x->count++;
+      UPDATE_PATH(t, x);
+      lock_release(&locks);
+      return x;
+    }
+
+    // 두 자식이 모두 red이면 색을 뒤집어서 red를 위로 올림
+    if (x->left->color == RBTREE_RED && x->right->color == RBTREE_RED)
+    {
+      x->color = RBTREE_RED;
+      x->left->color = RBTREE_BLACK;
+      x->right->color = RBTREE_BLACK;
+
+      if (p->color == RBTREE_RED)
+      {
+        // 올라온 노드는 black이므로 그 아래 두 단계에서는 g, great가 필요 없음
+        x = topdown_rotate(t, x, p, g);
+        p = great;
+        g = great = NULL;
+      }
+      if (p == t->nil)
+      {
+        x->color = RBTREE_BLACK;
+      }
+    }
+
+    node_t *next = (x->key >= key) ? x->left : x->right;
+    if (next == t->nil)
+      break;
+
+    lock_add(&locks, next);
+    great = g;
+    g = p;
+    p = x;
+    x = next;
+    lock_keep(&locks, great, g, p, x);
+  }
+
+  // 새 노드가 필요할 때만 예산을 확인. 쫓아내면 트리가 바뀌므로 처음부터 다시 내려감
+  if (!concurrent && t->budget != 0 && t->free_list == NULL && t->bytes + sizeof(node_t) > t->budget)
+  {
+    if (evict_for_insert(t) != 0)
+    {
+      return NULL;
+    }
+    return insert_topdown(t, key, 0);
+  }
+
+  node_t *node;
+  if (concurrent)
+  {
+    node = (node_t *)calloc(1, sizeof(node_t));
+    if (node != NULL)
+    {
+      account_shared(t, sizeof(node_t));
+      __atomic_fetch_add(&t->nodes, 1, __ATOMIC_RELAXED);
+    }
+  }
+  else
+  {
+    node = alloc_node(t);
+  }
+  if (node == NULL)
+  {
+    lock_release(&locks);
+    return NULL;
+  }
+
+  node->key = key;
+  node->count = 1;
+  node->color = RBTREE_RED;
+  node->left = t->nil;
+  node->right = t->nil;
+  node->parent = x;
+
+  if (x == t->nil)
+  {
+    node->color = RBTREE_BLACK;
+    t->root = node;
+  }
+  else
+  {
+    if (x->key >= key)
+      x->left = node;
+    else
+      x->right = node;
+
+    if (x->color == RBTREE_RED)
+    {
+      topdown_rotate(t, node, x, p);
+    }
+  }
+
+  UPDATE_PATH(t, node);
+  if (!concurrent)
+    hash_add(t, node);
+  lock_release(&locks);
+  return node;
+}
+
+/**
+ * @brief 내려가면서 red를 아래로 밀어 넣는 한 번의 경로로 key를 삭제하는 함수
+ *
+ * 경로의 노드 q와 다음 자식이 모두 black이면 색 뒤집기나 회전으로 q를 red로 만든 뒤 내려간다.
+ * 경로의 끝(자식이 하나 이하인 노드)은 항상 red이거나 루트이므로 떼어내도 재조정이 필요 없다.
+ * 찾은 노드에는 경로 끝 노드(직전 노드)의 key를 옮긴다. 회전은 q의 부모에서만 일어나므로
+ * 경로 위의 최근 3개 노드와 찾은 노드, 그리고 회전에 쓰이는 형제 노드만 잠그면 된다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param key 삭제할 key
+ * @param concurrent 0이 아니면 노드를 잠그며 내려가고, 해시 인덱스/재사용 목록을 사용하지 않음
+ * @return int 삭제했으면 0, key가 없으면 -1
+ */
+int erase_topdown(rbtree *t, const key_t key, const int concurrent)
+{
+  lock_set_t locks = {concurrent, 0, {NULL}};
+  node_t *g = NULL, *p = t->nil, *f = NULL;
+
+  lock_add(&locks, t->nil);
+  node_t *q = t->root;
+  if (q == t->nil)
+  {
+    lock_release(&locks);
+    return -1;
+  }
+  lock_add(&locks, q);
+
+  while (1)
+  {
+    const int go_left = (q->key >= key);
+    if (q->key == key)
+    {
+      // counted 모드에서 같은 key가 남아있으면 개수만 감소
+      if (q->count > 1)
+      {
+        q->count--;
+        UPDATE_PATH(t, q);
+        lock_release(&locks);
+        return 0;
+      }
+      f = q;
+    }
+
+    node_t *next = go_left ? q->left : q->right;
+    node_t *other = go_left ? q->right : q->left;
+
+    // q와 다음 자식이 모두 black이면 q를 red로 만듦
+    if (q->color == RBTREE_BLACK && next->color == RBTREE_BLACK)
+    {
+      if (other->color == RBTREE_RED)
+      {
+        // 반대쪽의 red 자식을 q 위로 올림
+        lock_add(&locks, other);
+        if (go_left)
+          left_rotate(t, q);
+        else
+          right_rotate(t, q);
+        other->color = RBTREE_BLACK;
+        q->color = RBTREE_RED;
+        p = other;
+      }
+      else if (p != t->nil)
+      {
+        const int q_left = (q == p->left);
+        node_t *s = q_left ? p->right : p->left;
+
+        if (s != t->nil)
+        {
+          lock_add(&locks, s);
+          node_t *near = q_left ? s->left : s->right;
+          node_t *far = q_left ? s->right : s->left;
+
+          if (near->color == RBTREE_BLACK && far->color == RBTREE_BLACK)
+          {
+            // 형제도 자식이 모두 black이면 색만 뒤집음 (p는 red였음)
+            p->color = RBTREE_BLACK;
+            s->color = RBTREE_RED;
+            q->color = RBTREE_RED;
+          }
+          else
+          {
+            // 형제의 red 자식을 p의 자리로 올림
+            node_t *top = s;
+            if (near->color == RBTREE_RED)
+            {
+              lock_add(&locks, near);
+              if (q_left)
+                right_rotate(t, s);
+              else
+                left_rotate(t, s);
+              top = near;
+            }
+            if (q_left)
+              left_rotate(t, p);
+            else
+              right_rotate(t, p);
+
+            q->color = RBTREE_RED;
+            top->color = (top->parent == t->nil) ? RBTREE_BLACK : RBTREE_RED;
+            top->left->color = RBTREE_BLACK;
+            top->right->color = RBTREE_BLACK;
+          }
+        }
+      }
+    }
+
+    if (next == t->nil)
+      break;
+
+    lock_add(&locks, next);
+    g = p;
+    p = q;
+    q = next;
+    lock_keep(&locks, g, p, q, f);
+  }
+
+  if (f == NULL)
+  {
+    lock_release(&locks);
+    return -1;
+  }
+
+  // q의 key를 f로 옮기고 q를 떼어냄 (q의 자식은 하나 이하)
+  node_t *child = (q->left == t->nil) ? q->right : q->left;
+  if (!concurrent)
+  {
+    hash_remove(t, f);
+    if (f != q)
+      hash_move(t, q, f);
+  }
+  f->key = q->key;
+  f->count = q->count;
+
+  if (p == t->nil)
+    t->root = child;
+  else if (p->left == q)
+    p->left = child;
+  else
+    p->right = child;
+
+  if (child != t->nil)
+  {
+    child->parent = p;
+    child->color = RBTREE_BLACK;
+  }
+  UPDATE_PATH(t, p);
+  lock_release(&locks);
+
+  if (!concurrent)
+  {
+    free_node(t, q);
+    return 0;
+  }
+
+  __atomic_fetch_sub(&t->nodes, 1, __ATOMIC_RELAXED);
+  if (t->block == NULL || q < t->block || q >= t->block + t->block_len)
+  {
+    // 블록 안의 노드는 다음 compact나 트리 삭제 때 블록과 함께 해제됨
+    free(q);
+    account_shared(t, -(ptrdiff_t)sizeof(node_t));
+  }
+  return 0;
+}
+
+/////////////////////////////////////////
+
+/**
+ * @brief 레드블랙 트리를 생성하는 함수
+ *
+ * @return rbtree*
+ */
+rbtree *new_rbtree(void)
+{
+  rbtree *p = (rbtree *)calloc(1, sizeof(rbtree));
+
+  node_t *NIL = (node_t *)calloc(1, sizeof(node_t));
+  NIL->color = RBTREE_BLACK;
+  NIL->key = -1;
+  NIL->left = NULL;
+  NIL->parent = NULL;
+  NIL->right = NULL;
+
+  p->nil = NIL;
+  p->root = NIL;
+#ifdef RBTREE_AUGMENT
+  NIL->summary = rbtree_summary_identity();
+#endif
+
+  atomic_fetch_add(&registry_trees, 1);
+  account(p, sizeof(rbtree) + sizeof(node_t));
+  return p;
+}
+
+/**
+ * @brief 같은 key를 하나의 노드에 개수(count)로 압축해서 저장하는 레드블랙 트리를 생성하는 함수
+ *
+ * 중복 key 삽입/삭제는 노드의 count만 증감시키므로
+ * 트리의 높이와 메모리 사용량이 전체 원소 수가 아닌 서로 다른 key의 수를 따른다.
+ *
+ * @return rbtree*
+ */
+rbtree *new_counted_rbtree(void)
+{
+  rbtree *p = new_rbtree();
+  p->counted = 1;
+  return p;
+}
+
+/**
+ * @brief 레드블랙 트리를 삭제하고 관련된 모든 메모리를 해제하는 함수
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ */
+void delete_rbtree(rbtree *t)
+{
+  reclaim_t r;
+
+  // 트리의 모든 노드, 재사용 목록, 연속 메모리 블록, nil 노드에 대한 메모리 해제
+  detach_nodes(t, &r);
+  reclaim_nodes(&r, (size_t)-1);
+
+  // 해시 인덱스와 쓰기 버퍼 해제
+  hash_free(t);
+  wbuf_free(t);
+
+  // 전역 합계에서 트리가 쥐고 있던 메모리를 뺌
+  atomic_fetch_sub(&registry_trees, 1);
+  atomic_fetch_sub(&registry_bytes, t->bytes);
+
+  // 트리 자체를 위해 할당된 메모리 해제
+  free(t);
+}
+
+/**
+ * @brief 레드블랙 트리를 바로 삭제하고 노드들의 메모리는 나중에 나눠서 반환하도록 넘기는 함수
+ *
+ * 노드 수와 관계없이 O(1)이므로 요청 처리 중에도 큰 트리를 멈춤 없이 버릴 수 있다.
+ * 넘겨진 노드들은 rbtree_reclaim_step을 부를 때마다 정해진 개수씩 반환된다.
+ * (전역 반환 목록을 사용하므로 이 함수와 rbtree_reclaim_step은 한 스레드에서만 불러야 한다)
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ */
+void delete_rbtree_deferred(rbtree *t)
+{
+  reclaim_t *r = (reclaim_t *)malloc(sizeof(reclaim_t));
+  if (r == NULL)
+  {
+    delete_rbtree(t);
+    return;
+  }
+
+  hash_free(t);
+  wbuf_free(t);
+  account(t, -(ptrdiff_t)sizeof(rbtree));
+
+  // 남은 노드들의 메모리는 반환이 끝날 때까지 pending으로 집계
+  detach_nodes(t, r);
+  r->next = reclaim_list;
+  reclaim_list = r;
+  atomic_fetch_sub(&registry_trees, 1);
+  atomic_fetch_sub(&registry_bytes, r->bytes);
+  atomic_fetch_add(&registry_pending, r->bytes);
+
+  free(t);
+}
+
+/**
+ * @brief delete_rbtree_deferred로 넘겨진 노드들의 메모리를 최대 budget개 반환하는 함수
+ *
+ * @param budget 이번 호출에서 반환할 최대 노드 개수
+ * @return size_t 아직 반환이 끝나지 않은 트리의 개수 (0이면 모두 반환됨)
+ */
+size_t rbtree_reclaim_step(const size_t budget)
+{
+  size_t done = 0;
+
+  while (reclaim_list != NULL && done < budget)
+  {
+    reclaim_t *r = reclaim_list;
+    size_t step = reclaim_nodes(r, budget - done);
+    done += step;
+
+    if (r->nil != NULL) // budget을 다 써서 아직 남음
+    {
+      break;
+    }
+    reclaim_list = r->next;
+    atomic_fetch_sub(&registry_pending, r->bytes);
+    free(r);
+  }
+
+  size_t pending = 0;
+  for (reclaim_t *r = reclaim_list; r != NULL; r = r->next)
+  {
+    pending++;
+  }
+  return pending;
+}
+
+/**
+ * @brief 레드블랙 트리에 주어진 key 값을 가진 노드를 삽입하는 함수
+ *
+ * 메모리 예산이 설정되어 있고 새 노드를 할당하면 예산을 넘는 경우, 정책에 따라 다른 원소를 먼저 쫓아낸다.
+ *
+ * @param t key를 삽입할 레드블랙 트리
+ * @param key 삽입하고자 하는 key 값
+ * @return node_t* 삽입한 노드 반환. counted 모드에서 같은 key가 이미 있으면 count를 증가시킨 해당 노드 반환.
+ *                 예산 안에 자리를 만들 수 없으면 NULL
+ */
+node_t *rbtree_insert(rbtree *t, const key_t key)
+{
+  node_t *parent = t->nil; // 삽입하는 노드의 부모가 될 노드
+  node_t *cur = t->root;   // 노드를 삽입할 위치
+
+  // 노드를 삽입할 위치 찾기
+  while (cur != t->nil)
+  {
+    // counted 모드에서는 같은 key의 노드가 있으면 개수만 증가
+    if (t->counted && cur->key == key)
+    {
+      cur->count++;
+      UPDATE_PATH(t, cur);
+      return cur;
+    }
+
+    parent = cur;
+    if (cur->key >= key)
+    {
+      cur = cur->left;
+    }
+    else
+    {
+      cur = cur->right;
+    }
+  }
+
+  // 예산을 넘으면 원소를 쫓아낸 뒤, 트리가 바뀌었으므로 위치를 다시 찾음
+  if (t->budget != 0 && t->free_list == NULL && t->bytes + sizeof(node_t) > t->budget)
+  {
+    if (evict_for_insert(t) != 0)
+    {
+      return NULL;
+    }
+    return rbtree_insert(t, key);
+  }
+
+  // 삽입할 노드를 위한 메모리 할당
+  node_t *new_node = alloc_node(t);
+  new_node->key = key;
+  new_node->count = 1;
+  new_node->color = RBTREE_RED;
+  new_node->left = t->nil;
+  new_node->right = t->nil;
+
+  // 삽입할 노드와 부모 연결시키기
+  new_node->parent = parent;
+
+  if (parent == t->nil)
+  {
+    t->root = new_node;
+  }
+  else if (parent->key >= key)
+  {
+    parent->left = new_node;
+  }
+  else
+  {
+    parent->right = new_node;
+  }
+
+  // 삽입 후 재조정
+  UPDATE_PATH(t, new_node);
+  insert_fixup(t, new_node);
+  hash_add(t, new_node);
+  return new_node;
+}
+
+/**
+ * @brief 레드블랙 트리에서 주어진 key 값을 찾는 함수
+ *
+ * 트리를 수정하지 않으므로 아직 쓰기 버퍼에 있는 key는 보지 않는다. (버퍼까지 보려면 rbtree_find_buffered)
+ *
+ * @param t 검색할 레드블랙 트리
+ * @param key 찾고자 하는 key 값
+ * @return node_t* key 값에 해당하는 노드 반환. 만약 key 값이 트리에 없다면 NULL 반환
+ */
+node_t *rbtree_find(const rbtree *t, const key_t key)
+{
+  // 해시 인덱스가 있으면 트리를 내려가지 않고 한 번의 탐색으로 찾음
+  if (t->hash != NULL)
+  {
+    const rbtree_hash *h = t->hash;
+    size_t i = hash_slot(h, key);
+    while (h->slots[i].node != NULL)
+    {
+      if (h->slots[i].key == key)
+      {
+        return h->slots[i].node;
+      }
+      i = (i + 1) & (h->cap - 1);
+    }
+    return NULL;
+  }
+
   node_t *current = t->root;
 
-  while (current->left != t->nil)
+  // key 값에 해당하는 노드 찾기
+  while (current != t->nil)
+  {
+    if (current->key == key)
+    {
+      return current;
+    }
+    else if (current->key > key)
+    {
+      current = current->left;
+    }
+    else
+    {
+      current = current->right;
+    }
+  }
+
+  // 존재하지 않으면 NULL 반환
+  return NULL;
+}
+
+/**
+ * @brief 여러 key를 한꺼번에 찾는 함수
+ *
+ * FIND_BATCH_GROUP개의 탐색을 한 단계씩 번갈아 진행하면서 각 탐색이 다음에 방문할 노드를
+ * 미리 prefetch하므로, 한 탐색의 캐시 미스를 기다리는 동안 다른 탐색들이 진행된다.
+ *
+ * @param t 검색할 레드블랙 트리
+ * @param keys 찾고자 하는 key 값들의 배열
+ * @param n keys의 크기
+ * @param nodes i번째 key에 대해 rbtree_find(t, keys[i])와 같은 결과를 저장할 배열 (쓰기 버퍼는 보지 않음)
+ */
+void rbtree_find_batch(const rbtree *t, const key_t *keys, const size_t n, node_t **nodes)
+{
+  node_t *cur[FIND_BATCH_GROUP];
+
+  // 해시 인덱스가 있으면 각각 한 번의 탐색으로 충분
+  if (t->hash != NULL)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      nodes[i] = rbtree_find(t, keys[i]);
+    }
+    return;
+  }
+
+  for (size_t base = 0; base < n; base += FIND_BATCH_GROUP)
+  {
+    size_t group = n - base < FIND_BATCH_GROUP ? n - base : FIND_BATCH_GROUP;
+    size_t active = group;
+
+    for (size_t i = 0; i < group; i++)
+    {
+      cur[i] = t->root;
+      nodes[base + i] = NULL;
+    }
+
+    // 모든 탐색이 끝날 때까지 한 단계씩 번갈아 진행
+    while (active > 0)
+    {
+      active = 0;
+      for (size_t i = 0; i < group; i++)
+      {
+        node_t *current = cur[i];
+        if (current == t->nil)
+          continue;
+
+        const key_t key = keys[base + i];
+        if (current->key == key)
+        {
+          nodes[base + i] = current;
+          cur[i] = t->nil;
+          continue;
+        }
+
+        current = (current->key > key) ? current->left : current->right;
+        cur[i] = current;
+        if (current != t->nil)
+        {
+          __builtin_prefetch(current);
+          active++;
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief 주어진 레드블랙 트리의 최소값 찾기
+ *
+ * 트리를 수정하지 않으므로 아직 쓰기 버퍼에 있는 key는 보지 않는다. (버퍼까지 보려면 rbtree_min_buffered)
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @return node_t* 최소값을 가진 노드 반환
+ */
+node_t *rbtree_min(const rbtree *t)
+{
+  if (t->root == t->nil)
+  {
+    return t->nil;
+  }
+
+  return leftmost(t, t->root);
+}
+
+/**
+ * @brief 주어진 레드블랙 트리의 최대값 찾기
+ *
+ * 트리를 수정하지 않으므로 아직 쓰기 버퍼에 있는 key는 보지 않는다. (버퍼까지 보려면 rbtree_max_buffered)
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @return node_t* 최대값을 가진 노드 반환
+ */
+node_t *rbtree_max(const rbtree *t)
+{
+  if (t->root == t->nil)
+  {
+    return t->nil;
+  }
+
+  return rightmost(t, t->root);
+}
+
+/**
+ * @brief 레드블랙 트리에서 주어진 노드를 삭제하는 함수
+ *
+ * counted 모드에서 노드의 count가 2 이상이면 노드는 그대로 두고 count만 감소시킨다.
+ *
+ * @param t 노드를 삭제할 레드블랙 트리
+ * @param p 삭제할 노드
+ * @return int
+ */
+int rbtree_erase(rbtree *t, node_t *p)
+{
+  // counted 모드에서 같은 key가 남아있으면 개수만 감소
+  if (p->count > 1)
+  {
+    p->count--;
+    UPDATE_PATH(t, p);
+    return 0;
+  }
+
+  node_t *temp = p;
+  color_t del_color = temp->color;
+  node_t *replaced;
+
+  hash_remove(t, p);
+
+  if (temp->left == t->nil) // 왼쪽 자식이 없는 경우
+  {
+    replaced = temp->right;
+    transplant(t, temp, temp->right);
+  }
+  else if (temp->right == t->nil) // 오른쪽 자식이 없는 경우
+  {
+    replaced = temp->left;
+    transplant(t, temp, temp->left);
+  }
+  else // 자식이 2개 있는 경우
+  {
+    // 후임자 찾기
+    rbtree *subtree = (rbtree *)calloc(1, sizeof(rbtree));
+    subtree->root = p->right;
+    subtree->nil = t->nil;
+    temp = rbtree_min(subtree);
+    free(subtree);
+
+    del_color = temp->color;
+    replaced = temp->right;
+
+    // 후임자의 key가 p로 옮겨지므로 해시 엔트리도 p를 가리키도록 변경
+    hash_move(t, temp, p);
+    p->key = temp->key;
+    p->count = temp->count;
+    transplant(t, temp, temp->right);
+  }
+
+  // 빠진 위치의 부모부터 루트까지 summary 갱신 (key가 바뀐 p도 이 경로에 있음)
+  UPDATE_PATH(t, replaced->parent);
+
+  // 삭제한 노드의 색상이 Black일 경우 재조정
+  if (del_color == RBTREE_BLACK)
+  {
+    erase_fixup(t, replaced);
+  }
+
+  // 삭제한 노드에 대한 메모리 반환
+  free_node(t, temp);
+  return 0;
+}
+
+/**
+ * @brief 트리 안의 노드 p의 key를 new_key로 바꾸는 함수
+ *
+ * new_key가 여전히 이전/다음 노드 사이에 들어가면 key만 바꾸고,
+ * 그렇지 않으면 같은 노드를 떼어내서 새 위치에 다시 연결한다. 메모리 할당/해제는 일어나지 않는다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param p key를 바꿀 노드
+ * @param new_key 새로운 key 값
+ * @return node_t* new_key를 가진 노드. counted 모드에서 new_key가 이미 있으면 그 노드로 합쳐지고
+ *                 p는 재사용을 위해 반납된다. 그 외에는 항상 p
+ */
+node_t *rbtree_update_key(rbtree *t, node_t *p, const key_t new_key)
+{
+  if (p->key == new_key)
+  {
+    return p;
+  }
+
+  // counted 모드에서는 같은 key의 노드가 하나뿐이어야 하므로 기존 노드에 개수를 합침
+  if (t->counted)
+  {
+    node_t *same = rbtree_find(t, new_key);
+    if (same != NULL)
+    {
+      same->count += p->count;
+      hash_remove(t, p);
+      unlink_node(t, p);
+      recycle_node(t, p);
+      UPDATE_PATH(t, same);
+      return same;
+    }
+  }
+
+  // 이전/다음 노드 사이에 그대로 들어가면 key만 변경
+  node_t *prev = predecessor(t, p);
+  node_t *next = successor(t, p);
+  hash_remove(t, p);
+  if ((prev == t->nil || prev->key <= new_key) &&
+      (next == t->nil || new_key <= next->key))
+  {
+    p->key = new_key;
+    UPDATE_PATH(t, p);
+    hash_add(t, p);
+    return p;
+  }
+
+  // 같은 노드를 떼어내서 새 위치에 다시 연결
+  unlink_node(t, p);
+  p->key = new_key;
+  link_node(t, p);
+  hash_add(t, p);
+  return p;
+}
+
+/**
+ * @brief 레드블랙 트리에서 최소값을 꺼내는 함수
+ *
+ * 꺼낸 노드는 해제하지 않고 다음 삽입에서 재사용한다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param key 꺼낸 값을 저장할 위치
+ * @return int 성공하면 0, 트리가 비어있으면 -1
+ */
+int rbtree_pop_min(rbtree *t, key_t *key)
+{
+  node_t *min = (t->root == t->nil) ? t->nil : leftmost(t, t->root);
+
+  // 쓰기 버퍼에 더 작은 값이 있으면 트리에 합치지 않고 바로 꺼냄
+  if (wbuf_pop_min(t, min, key))
+  {
+    return 0;
+  }
+
+  if (min == t->nil)
+  {
+    return -1;
+  }
+
+  *key = min->key;
+
+  if (min->count > 1)
+  {
+    min->count--;
+    UPDATE_PATH(t, min);
+    return 0;
+  }
+
+  // 최소 노드는 왼쪽 자식이 없음
+  hash_remove(t, min);
+  unlink_edge(t, min, min->right);
+  recycle_node(t, min);
+  return 0;
+}
+
+/**
+ * @brief 레드블랙 트리에서 최대값을 꺼내는 함수
+ *
+ * 꺼낸 노드는 해제하지 않고 다음 삽입에서 재사용한다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param key 꺼낸 값을 저장할 위치
+ * @return int 성공하면 0, 트리가 비어있으면 -1
+ */
+int rbtree_pop_max(rbtree *t, key_t *key)
+{
+  node_t *max = (t->root == t->nil) ? t->nil : rightmost(t, t->root);
+
+  // 쓰기 버퍼에 더 큰 값이 있으면 트리에 합치지 않고 바로 꺼냄
+  if (wbuf_pop_max(t, max, key))
+  {
+    return 0;
+  }
+
+  if (max == t->nil)
+  {
+    return -1;
+  }
+
+  *key = max->key;
+
+  if (max->count > 1)
+  {
+    max->count--;
+    UPDATE_PATH(t, max);
+    return 0;
+  }
+
+  // 최대 노드는 오른쪽 자식이 없음
+  hash_remove(t, max);
+  unlink_edge(t, max, max->left);
+  recycle_node(t, max);
+  return 0;
+}
+
+/**
+ * @brief 레드블랙 트리에서 작은 값부터 최대 k개를 꺼내 arr에 저장하는 함수
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param arr 꺼낸 값을 저장할 배열
+ * @param k 꺼낼 최대 개수 (배열의 크기)
+ * @return size_t 실제로 꺼낸 개수
+ */
+size_t rbtree_drain_min(rbtree *t, key_t *arr, const size_t k)
+{
+  size_t popped = 0;
+  node_t *min = (t->root == t->nil) ? t->nil : leftmost(t, t->root);
+
+  while (popped < k)
+  {
+    // 트리와 쓰기 버퍼 중 더 작은 쪽에서 꺼냄
+    if (wbuf_pop_min(t, min, &arr[popped]))
+    {
+      popped++;
+      continue;
+    }
+
+    if (min == t->nil)
+    {
+      break;
+    }
+
+    arr[popped++] = min->key;
+
+    if (min->count > 1)
+    {
+      min->count--;
+      UPDATE_PATH(t, min);
+      continue;
+    }
+
+    // 다음 최소 노드는 오른쪽 자식(왼쪽 자식이 없으므로 Red leaf) 또는 부모.
+    // 재조정의 회전은 중위 순서를 바꾸지 않으므로 미리 구해둘 수 있다.
+    node_t *next = (min->right != t->nil) ? min->right : min->parent;
+
+    hash_remove(t, min);
+    unlink_edge(t, min, min->right);
+    recycle_node(t, min);
+    min = next;
+  }
+
+  return popped;
+}
+
+/**
+ * @brief 레드블랙 트리에 저장된 값을 크기 n의 배열에 저장하는 함수
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param arr 값을 저장할 배열
+ * @param n 배열의 크기
+ * @return int
+ */
+int rbtree_to_array(const rbtree *t, key_t *arr, const size_t n)
+{
+  int *index = (int *)calloc(1, sizeof(int));
+  *index = 0;
+  // 중위 순회
+  inorder(t, arr, index, n);
+
+  // 쓰기 버퍼가 있으면 트리에 합치지 않고 결과에 병합
+  const rbtree_wbuf *w = t->wbuf;
+  if (w != NULL && w->len > 0)
+  {
+    const key_t *buf = w->keys + w->start;
+    size_t from_tree = *index, from_buf = 0;
+
+    // 작은 값 n개 안에 들어가는 트리/버퍼 원소의 개수 구하기
+    size_t i = 0, j = 0;
+    while (i + j < n && (i < from_tree || j < w->len))
+    {
+      if (j < w->len && (i == from_tree || buf[j] < arr[i]))
+        j++;
+      else
+        i++;
+    }
+    from_tree = i;
+    from_buf = j;
+
+    // 뒤에서부터 병합하면 arr 안에서 바로 합칠 수 있음
+    size_t k = from_tree + from_buf;
+    while (from_buf > 0)
+    {
+      if (from_tree > 0 && arr[from_tree - 1] > buf[from_buf - 1])
+        arr[--k] = arr[--from_tree];
+      else
+        arr[--k] = buf[--from_buf];
+    }
+  }
+
+  free(index);
+  return 0;
+}
+
+/**
+ * @brief 레드블랙 트리의 모든 노드를 새로 할당한 연속 메모리로 옮기는 함수
+ *
+ * 노드들을 BFS 순서로 하나의 블록에 복사하고 parent/left/right 포인터를 고친다.
+ * 위쪽 level의 노드들이 인접하게 모이므로 오랜 삽입/삭제로 흩어진 노드들의 탐색 지역성이 회복된다.
+ * 트리는 이후에도 그대로 수정할 수 있지만, 이전에 받은 노드 포인터는 모두 무효가 된다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @return int 성공하면 0, 메모리 할당에 실패하면 -1 (트리는 그대로 유지)
+ */
+int rbtree_compact(rbtree *t)
+{
+  size_t n = count_nodes(t, t->root);
+  node_t *old_block = t->block;
+  node_t *block = NULL;
+
+  if (n > 0)
+  {
+    block = (node_t *)malloc(n * sizeof(node_t));
+    if (block == NULL)
+    {
+      return -1;
+    }
+  }
+
+  // 재사용 목록은 새 블록으로 옮기지 않고 정리
+  release_free_list(t);
+
+  if (n > 0)
+  {
+    copy_level_order(t, block, t->nil, t);
+  }
+
+  // 이전 블록의 노드들은 free_node에서 재사용 목록에 반납되었으므로 목록째 버림
+  t->free_list = NULL;
+  free(old_block);
+  account(t, ((ptrdiff_t)n - (ptrdiff_t)t->block_len) * (ptrdiff_t)sizeof(node_t));
+
+  t->block = block;
+  t->block_len = n;
+  t->nodes = n;
+  t->root = (n > 0) ? &block[0] : t->nil;
+
+  // 노드 주소가 모두 바뀌었으므로 해시 인덱스를 다시 구성
+  if (t->hash != NULL)
+  {
+    rbtree_hash *h = t->hash;
+    memset(h->slots, 0, h->cap * sizeof(struct hash_entry));
+    h->len = 0;
+    hash_add_subtree(t, t->root);
+  }
+  return 0;
+}
+
+/**
+ * @brief 호출한 쪽에서 할당한 노드를 중위 순서상 pos 바로 다음 위치에 연결하는 함수
+ *
+ * key를 비교하지 않고 위치를 정하므로 node->key는 pos의 key 이상, 다음 노드의 key 이하여야 한다.
+ * 연결한 노드는 호출한 쪽의 메모리이며 트리는 이를 해제하지 않는다.
+ * - 떼어낼 때는 rbtree_erase/rbtree_pop_*가 아닌 rbtree_unlink를 사용한다 (앞의 함수들은 노드를 해제하거나 재사용함).
+ * - delete_rbtree는 남은 노드를 모두 free()하므로, 그 전에 노드들을 떼어내거나 직접 해제한 뒤 root를 nil로 비운다.
+ * - rbtree_compact/rbtree_clone은 node_t만 복사하므로 연결한 노드가 있는 트리에는 사용할 수 없다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param pos 기준 노드. NULL이면 가장 앞에 연결
+ * @param node 연결할 노드
+ */
+void rbtree_link_after(rbtree *t, node_t *pos, node_t *node)
+{
+  // 호출한 쪽의 메모리는 초기화되어 있지 않을 수 있으므로 트리가 읽는 필드를 모두 채움
+  node->count = 1;
+  node->lock = 0;
+  node->color = RBTREE_RED;
+  node->left = t->nil;
+  node->right = t->nil;
+
+  if (t->root == t->nil)
+  {
+    node->parent = t->nil;
+    t->root = node;
+  }
+  else if (pos == NULL)
+  {
+    // 최소 노드의 왼쪽 자식으로 연결
+    node_t *min = leftmost(t, t->root);
+    node->parent = min;
+    min->left = node;
+  }
+  else if (pos->right == t->nil)
+  {
+    node->parent = pos;
+    pos->right = node;
+  }
+  else
+  {
+    // 오른쪽 서브트리의 최소 노드의 왼쪽 자식으로 연결
+    node_t *cur = pos->right;
+    while (cur->left != t->nil)
+    {
+      cur = cur->left;
+    }
+    node->parent = cur;
+    cur->left = node;
+  }
+
+  UPDATE_PATH(t, node);
+  insert_fixup(t, node);
+  hash_add(t, node);
+}
+
+/**
+ * @brief 노드를 해제하지 않고 트리에서 떼어내는 함수
+ *
+ * 다른 노드의 key를 옮기지 않으므로 트리에 남은 노드들의 포인터는 그대로 유효하다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param p 떼어낼 노드
+ */
+void rbtree_unlink(rbtree *t, node_t *p)
+{
+  hash_remove(t, p);
+  unlink_node(t, p);
+}
+
+/**
+ * @brief 중위 순서상 p 다음 노드를 찾는 함수
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param p 기준 노드
+ * @return node_t* 다음 노드. p가 마지막 노드이면 NULL
+ */
+node_t *rbtree_next(const rbtree *t, node_t *p)
+{
+  node_t *next = successor(t, p);
+  return (next == t->nil) ? NULL : next;
+}
+
+/**
+ * @brief 정확히 일치하는 key의 rbtree_find를 O(1)로 만드는 해시 인덱스를 켜는 함수
+ *
+ * 인덱스는 이후의 삽입/삭제/key 변경에서 함께 갱신되며, min/max/to_array 같은 순서 연산은 계속 트리를 사용한다.
+ * 인덱스를 키우는 중 메모리가 부족하면 인덱스는 자동으로 꺼진다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @return int 성공하면 0, 메모리 할당에 실패하면 -1
+ */
+int rbtree_enable_hash(rbtree *t)
+{
+  if (t->hash != NULL)
+  {
+    return 0;
+  }
+
+  rbtree_hash *h = (rbtree_hash *)calloc(1, sizeof(rbtree_hash));
+  if (h == NULL)
+  {
+    return -1;
+  }
+
+  // 현재 노드 수에 맞춰 처음부터 충분한 슬롯을 할당
+  size_t cap = HASH_MIN_CAP;
+  size_t n = count_nodes(t, t->root);
+  while (cap < n * 2)
+  {
+    cap *= 2;
+  }
+
+  h->slots = (struct hash_entry *)calloc(cap, sizeof(struct hash_entry));
+  if (h->slots == NULL)
   {
-    current = current->left;
+    free(h);
+    return -1;
   }
+  h->cap = cap;
 
-  return current;
+  t->hash = h;
+  account(t, sizeof(rbtree_hash) + cap * sizeof(struct hash_entry));
+  hash_add_subtree(t, t->root);
+  return t->hash != NULL ? 0 : -1;
 }
 
 /**
- * @brief 주어진 레드블랙 트리의 최대값 찾기
+ * @brief 해시 인덱스를 끄고 메모리를 반환하는 함수
  *
  * @param t 대상이 되는 레드블랙 트리
- * @return node_t* 최대값을 가진 노드 반환
  */
-node_t *rbtree_max(const rbtree *t)
+void rbtree_disable_hash(rbtree *t)
 {
-  node_t *current = t->root;
+  hash_free(t);
+}
+
+#ifdef RBTREE_AUGMENT
+/**
+ * @brief key가 [lo, hi] 범위에 있는 모든 원소의 summary를 구하는 함수
+ *
+ * 범위의 경계를 따라 내려가는 두 경로에서 범위에 완전히 포함되는 서브트리의 summary만 합치므로 O(log n)이다.
+ * 결합 순서는 key 순서를 따르므로 교환법칙이 없는 monoid도 사용할 수 있다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param lo 범위의 하한 (포함)
+ * @param hi 범위의 상한 (포함)
+ * @return rbtree_summary_t 트리에 합쳐진 원소들로 구한 범위의 summary (쓰기 버퍼는 보지 않음). 범위가 비어있으면 identity
+ */
+rbtree_summary_t rbtree_range_aggregate(const rbtree *t, const key_t lo, const key_t hi)
+{
+  node_t *split = t->root;
+
+  // 두 경계의 경로가 갈라지는 노드 찾기
+  while (split != t->nil && (split->key < lo || split->key > hi))
+  {
+    split = (split->key < lo) ? split->right : split->left;
+  }
+
+  if (split == t->nil || lo > hi)
+  {
+    return rbtree_summary_identity();
+  }
+
+  // 왼쪽 서브트리에서 key >= lo 인 부분 (오른쪽에서 왼쪽으로 쌓음)
+  rbtree_summary_t left = rbtree_summary_identity();
+  for (node_t *x = split->left; x != t->nil;)
+  {
+    if (x->key >= lo)
+    {
+      left = rbtree_summary_combine(
+          rbtree_summary_combine(rbtree_summary_of(x->key, x->count), x->right->summary), left);
+      x = x->left;
+    }
+    else
+    {
+      x = x->right;
+    }
+  }
 
-  while (current->right != t->nil)
+  // 오른쪽 서브트리에서 key <= hi 인 부분 (왼쪽에서 오른쪽으로 쌓음)
+  rbtree_summary_t right = rbtree_summary_identity();
+  for (node_t *x = split->right; x != t->nil;)
   {
-    current = current->right;
+    if (x->key <= hi)
+    {
+      right = rbtree_summary_combine(
+          right, rbtree_summary_combine(x->left->summary, rbtree_summary_of(x->key, x->count)));
+      x = x->right;
+    }
+    else
+    {
+      x = x->left;
+    }
   }
 
-  return current;
+  return rbtree_summary_combine(
+      rbtree_summary_combine(left, rbtree_summary_of(split->key, split->count)), right);
 }
+#endif
 
 /**
- * @brief 레드블랙 트리에서 주어진 노드를 삭제하는 함수
+ * @brief 삽입을 잠시 모아두었다가 트리에 나눠서 합치는 쓰기 버퍼를 켜는 함수
  *
- * @param t 노드를 삭제할 레드블랙 트리
- * @param p 삭제할 노드
- * @return int
+ * rbtree_insert_buffered로 넣은 key는 정렬된 버퍼에 먼저 쌓이고, 버퍼가 가득 차면
+ * 삽입마다 WBUF_MERGE_STEP개씩만 트리에 합쳐지므로 한 번의 삽입이 오래 걸리지 않는다.
+ * to_array/pop/drain은 버퍼와 트리를 함께 보고, 노드를 돌려주는 rbtree_*_buffered는 필요한 key 하나만 트리로 옮긴다.
+ * const로 받는 읽기 연산(find/min/max/find_batch/range_aggregate)은 트리를 수정하지 않으며 버퍼를 보지 않는다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param cap 버퍼에 모아둘 수 있는 key의 개수
+ * @return int 성공하면 0, 실패하면 -1
  */
-int rbtree_erase(rbtree *t, node_t *p)
+int rbtree_enable_write_buffer(rbtree *t, const size_t cap)
 {
-  node_t *temp = p;
-  color_t del_color = temp->color;
-  node_t *replaced;
-
-  if (temp->left == t->nil) // 왼쪽 자식이 없는 경우
+  if (t->wbuf != NULL || cap == 0)
   {
-    replaced = temp->right;
-    transplant(t, temp, temp->right);
+    return -1;
   }
-  else if (temp->right == t->nil) // 오른쪽 자식이 없는 경우
+
+  rbtree_wbuf *w = (rbtree_wbuf *)malloc(sizeof(rbtree_wbuf) + cap * sizeof(key_t));
+  if (w == NULL)
   {
-    replaced = temp->left;
-    transplant(t, temp, temp->left);
+    return -1;
   }
-  else // 자식이 2개 있는 경우
+  w->cap = cap;
+  w->start = 0;
+  w->len = 0;
+
+  t->wbuf = w;
+  account(t, sizeof(rbtree_wbuf) + cap * sizeof(key_t));
+  return 0;
+}
+
+/**
+ * @brief 버퍼의 key를 모두 트리에 합치고 쓰기 버퍼를 끄는 함수
+ *
+ * 메모리 예산 때문에 합치지 못한 key가 남으면 key를 잃지 않도록 버퍼를 그대로 둔다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @return int 버퍼를 껐으면 0, 남은 key가 있어 끄지 못했으면 -1
+ */
+int rbtree_disable_write_buffer(rbtree *t)
+{
+  if (t->wbuf == NULL)
+    return 0;
+
+  if (wbuf_flush(t) != 0)
   {
-    // 후임자 찾기
-    rbtree *subtree = (rbtree *)calloc(1, sizeof(rbtree));
-    subtree->root = p->right;
-    subtree->nil = t->nil;
-    temp = rbtree_min(subtree);
-    free(subtree);
+    return -1;
+  }
+  wbuf_free(t);
+  return 0;
+}
 
-    del_color = temp->color;
-    replaced = temp->right;
+/**
+ * @brief key를 쓰기 버퍼에 추가하는 함수 (버퍼가 없으면 바로 삽입)
+ *
+ * 삽입된 노드를 돌려주지 않으므로, 노드가 필요하면 이후에 rbtree_find_buffered로 찾는다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param key 삽입하고자 하는 key 값
+ * @return int 성공하면 0, 버퍼가 가득 찼는데 메모리 예산 때문에 합칠 수 없으면 -1
+ */
+int rbtree_insert_buffered(rbtree *t, const key_t key)
+{
+  rbtree_wbuf *w = t->wbuf;
+  if (w == NULL)
+  {
+    return rbtree_insert(t, key) != NULL ? 0 : -1;
+  }
 
-    p->key = temp->key;
-    transplant(t, temp, temp->right);
+  // 버퍼가 가득 찼으면 일부만 트리에 합쳐서 자리를 만듦
+  if (w->len == w->cap)
+  {
+    if (wbuf_merge(t, WBUF_MERGE_STEP) == 0)
+    {
+      return -1;
+    }
   }
 
-  // 삭제한 노드의 색상이 Black일 경우 재조정
-  if (del_color == RBTREE_BLACK)
+  // 뒤쪽에 자리가 없으면 앞쪽의 빈 공간으로 당김
+  if (w->start + w->len == w->cap)
   {
-    erase_fixup(t, replaced);
+    memmove(w->keys, w->keys + w->start, w->len * sizeof(key_t));
+    w->start = 0;
   }
 
-  // 삭제한 노드에 대한 메모리 반환
-  free(temp);
+  size_t pos = w->start + wbuf_lower_bound(w, key);
+  memmove(w->keys + pos + 1, w->keys + pos, (w->start + w->len - pos) * sizeof(key_t));
+  w->keys[pos] = key;
+  w->len++;
   return 0;
 }
 
 /**
- * @brief 레드블랙 트리에 저장된 값을 크기 n의 배열에 저장하는 함수
+ * @brief 쓰기 버퍼의 key를 최대 budget개 트리에 합치는 함수
+ *
+ * 한가한 시간에 불러서 버퍼를 미리 비워두면 이후의 쓰기 몰림을 더 많이 흡수할 수 있다.
  *
  * @param t 대상이 되는 레드블랙 트리
- * @param arr 값을 저장할 배열
- * @param n 배열의 크기
- * @return int
+ * @param budget 합칠 최대 개수
+ * @return size_t 버퍼에 남은 key의 개수
  */
-int rbtree_to_array(const rbtree *t, key_t *arr, const size_t n)
+size_t rbtree_flush_step(rbtree *t, const size_t budget)
 {
-  int *index = (int *)calloc(1, sizeof(int));
-  *index = 0;
-  // 중위 순회
-  inorder(t, arr, index, n);
-  free(index);
+  if (t->wbuf == NULL)
+    return 0;
+
+  wbuf_merge(t, budget);
+  return t->wbuf->len;
+}
+
+/**
+ * @brief 레드블랙 트리 전체를 복사하는 함수
+ *
+ * 삽입을 반복하지 않고 구조와 색을 그대로 하나의 연속 메모리 블록에 복사하므로 O(n)이다.
+ * counted 모드, 해시 인덱스, 쓰기 버퍼의 내용과 메모리 예산 설정도 함께 복사된다.
+ *
+ * @param t 복사할 레드블랙 트리
+ * @return rbtree* 복사본. 메모리 할당에 실패하면 NULL
+ */
+rbtree *rbtree_clone(const rbtree *t)
+{
+  rbtree *c = new_rbtree();
+  size_t n = count_nodes(t, t->root);
+
+  c->counted = t->counted;
+  c->budget = t->budget;
+  c->evict = t->evict;
+  c->evict_fn = t->evict_fn;
+  c->evict_arg = t->evict_arg;
+  if (n > 0)
+  {
+    c->block = (node_t *)malloc(n * sizeof(node_t));
+    if (c->block == NULL)
+    {
+      delete_rbtree(c);
+      return NULL;
+    }
+    c->block_len = n;
+    c->nodes = n;
+    account(c, n * sizeof(node_t));
+    copy_level_order(t, c->block, c->nil, NULL);
+    c->root = &c->block[0];
+  }
+
+  if (t->hash != NULL && rbtree_enable_hash(c) != 0)
+  {
+    delete_rbtree(c);
+    return NULL;
+  }
+
+  const rbtree_wbuf *w = t->wbuf;
+  if (w != NULL)
+  {
+    if (rbtree_enable_write_buffer(c, w->cap) != 0)
+    {
+      delete_rbtree(c);
+      return NULL;
+    }
+    memcpy(c->wbuf->keys, w->keys + w->start, w->len * sizeof(key_t));
+    c->wbuf->len = w->len;
+  }
+
+  return c;
+}
+
+/**
+ * @brief 트리가 쥐고 있는 메모리의 크기를 반환하는 함수
+ *
+ * 트리 자체, nil 노드, 노드들(재사용 목록과 연속 메모리 블록 포함), 해시 인덱스, 쓰기 버퍼를 모두 센다.
+ * rbtree_link_after로 연결한 노드는 호출한 쪽의 메모리이므로 세지 않는다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @return size_t 바이트 수
+ */
+size_t rbtree_memory_usage(const rbtree *t)
+{
+  return t->bytes;
+}
+
+/**
+ * @brief 트리의 메모리 예산과 예산을 넘을 때의 정책을 정하는 함수
+ *
+ * 예산은 새 노드를 할당하는 rbtree_insert에서만 지켜지며, 이미 예산을 넘고 있으면 다음 삽입에서 그만큼 쫓아낸다.
+ * 해시 인덱스가 커지는 것도 예산에 포함되지만, 해시 인덱스와 쓰기 버퍼는 줄어들지 않으므로 예산은 그보다 커야 한다.
+ * counted 모드에서는 서로 다른 key 단위로 쫓아내므로, 쫓아낸 key의 중복 개수도 모두 함께 지워진다.
+ * 쓰기 버퍼에서 트리로 합쳐지는 key가 거부되면 그 key는 버퍼에 남고, 버퍼가 가득 차면 rbtree_insert_buffered가 거부된다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param budget 최대 바이트 수. 0이면 제한 없음
+ * @param evict 예산을 넘을 때의 정책 (RBTREE_EVICT_CALLBACK은 rbtree_set_evict_callback으로 함수를 먼저 지정)
+ */
+void rbtree_set_memory_budget(rbtree *t, const size_t budget, const rbtree_evict_t evict)
+{
+  t->budget = budget;
+  t->evict = evict;
+}
+
+/**
+ * @brief RBTREE_EVICT_CALLBACK 정책에서 쫓아낼 노드를 고르는 함수를 지정하는 함수
+ *
+ * fn은 트리의 노드 하나를 반환하면 그 노드가 rbtree_erase로 지워지고, NULL을 반환하면 삽입이 거부된다.
+ * fn 안에서 트리를 수정하면 안 된다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param fn 쫓아낼 노드를 고르는 함수
+ * @param arg fn에 그대로 전달할 값
+ */
+void rbtree_set_evict_callback(rbtree *t, rbtree_evict_fn fn, void *arg)
+{
+  t->evict_fn = fn;
+  t->evict_arg = arg;
+}
+
+/**
+ * @brief 프로세스의 모든 트리의 메모리 사용량 합계를 구하는 함수
+ *
+ * 각 값은 따로 읽으므로 다른 스레드가 트리를 수정하는 중에는 값들 사이가 정확히 맞지 않을 수 있다.
+ *
+ * @param stats 합계를 저장할 위치
+ */
+void rbtree_memory_registry(rbtree_memory_stats *stats)
+{
+  stats->trees = atomic_load(&registry_trees);
+  stats->bytes = atomic_load(&registry_bytes);
+  stats->peak_bytes = atomic_load(&registry_peak);
+  stats->pending_bytes = atomic_load(&registry_pending);
+}
+
+/**
+ * @brief 내려가는 한 번의 경로에서 재조정까지 끝내는 삽입 함수
+ *
+ * rbtree_insert와 같은 결과를 내지만 부모 포인터를 따라 다시 올라가지 않는다.
+ * (-DRBTREE_AUGMENT 빌드에서는 summary 갱신을 위해 마지막에 한 번 올라간다)
+ *
+ * @param t key를 삽입할 레드블랙 트리
+ * @param key 삽입하고자 하는 key 값
+ * @return node_t* 삽입한 노드. 예산 안에 자리를 만들 수 없으면 NULL
+ */
+node_t *rbtree_insert_topdown(rbtree *t, const key_t key)
+{
+  return insert_topdown(t, key, 0);
+}
+
+/**
+ * @brief 내려가는 한 번의 경로에서 재조정까지 끝내는 삭제 함수
+ *
+ * 노드가 아닌 key로 삭제한다. 같은 key가 여러 개면 그 중 하나를 지운다.
+ * rbtree_erase처럼 다른 노드의 key가 옮겨질 수 있으므로 이전에 받은 노드 포인터의 key가 바뀔 수 있다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param key 삭제할 key 값
+ * @return int 삭제했으면 0, key가 없으면 -1
+ */
+int rbtree_erase_topdown(rbtree *t, const key_t key)
+{
+  return erase_topdown(t, key, 0);
+}
+
+#ifndef RBTREE_AUGMENT
+/**
+ * @brief 여러 스레드가 동시에 부를 수 있는 삽입 함수
+ *
+ * 루트에서부터 노드를 잠그며 내려가고(lock coupling), 재조정에 필요한 최근 몇 개의 노드만 잠근 채로 둔다.
+ * 서로 다른 key 범위를 수정하는 스레드들은 루트 근처를 지난 뒤에는 서로 기다리지 않는다.
+ * 동시에 사용하는 동안에는 rbtree_*_concurrent만 불러야 하며, 해시 인덱스, 쓰기 버퍼, 메모리 예산은 꺼져 있어야 한다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param key 삽입하고자 하는 key 값
+ * @return int 성공하면 0, 메모리 할당에 실패하면 -1
+ */
+int rbtree_insert_concurrent(rbtree *t, const key_t key)
+{
+  return insert_topdown(t, key, 1) != NULL ? 0 : -1;
+}
+
+/**
+ * @brief 여러 스레드가 동시에 부를 수 있는 삭제 함수
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param key 삭제할 key 값
+ * @return int 삭제했으면 0, key가 없으면 -1
+ */
+int rbtree_erase_concurrent(rbtree *t, const key_t key)
+{
+  return erase_topdown(t, key, 1);
+}
+
+/**
+ * @brief 여러 스레드가 동시에 부를 수 있는 탐색 함수
+ *
+ * 다른 스레드가 노드를 지울 수 있으므로 노드 대신 key의 존재 여부를 반환한다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @param key 찾고자 하는 key 값
+ * @return int key가 있으면 1, 없으면 0
+ */
+int rbtree_find_concurrent(rbtree *t, const key_t key)
+{
+  spin_lock(t->nil);
+  node_t *x = t->root;
+  if (x != t->nil)
+    spin_lock(x);
+  spin_unlock(t->nil);
+
+  while (x != t->nil)
+  {
+    if (x->key == key)
+    {
+      spin_unlock(x);
+      return 1;
+    }
+
+    node_t *next = (key < x->key) ? x->left : x->right;
+    if (next != t->nil)
+      spin_lock(next);
+    spin_unlock(x);
+    x = next;
+  }
   return 0;
-}
\ No newline at end of file
+}
+#endif
+
+/**
+ * @brief 쓰기 버퍼까지 포함해서 key를 찾는 함수
+ *
+ * key가 버퍼에만 있으면 그 key 하나만 트리로 옮겨서 노드를 돌려준다.
+ *
+ * @param t 검색할 레드블랙 트리
+ * @param key 찾고자 하는 key 값
+ * @return node_t* key 값에 해당하는 노드. 없거나 예산 때문에 트리로 옮기지 못하면 NULL
+ */
+node_t *rbtree_find_buffered(rbtree *t, const key_t key)
+{
+  node_t *node = rbtree_find(t, key);
+  const rbtree_wbuf *w = t->wbuf;
+  if (node != NULL || w == NULL)
+    return node;
+
+  size_t i = wbuf_lower_bound(w, key);
+  if (i == w->len || w->keys[w->start + i] != key)
+    return NULL;
+  return wbuf_promote(t, i);
+}
+
+/**
+ * @brief 쓰기 버퍼까지 포함해서 최소값을 찾는 함수
+ *
+ * 버퍼의 최소값이 트리의 최소값보다 작으면 그 key 하나만 트리로 옮긴다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @return node_t* 최소값을 가진 노드 (비어있으면 nil). 예산 때문에 트리로 옮기지 못하면 NULL
+ */
+node_t *rbtree_min_buffered(rbtree *t)
+{
+  const rbtree_wbuf *w = t->wbuf;
+  if (w != NULL && w->len > 0 &&
+      (t->root == t->nil || w->keys[w->start] < leftmost(t, t->root)->key))
+  {
+    return wbuf_promote(t, 0);
+  }
+  return rbtree_min(t);
+}
+
+/**
+ * @brief 쓰기 버퍼까지 포함해서 최대값을 찾는 함수
+ *
+ * 버퍼의 최대값이 트리의 최대값보다 크면 그 key 하나만 트리로 옮긴다.
+ *
+ * @param t 대상이 되는 레드블랙 트리
+ * @return node_t* 최대값을 가진 노드 (비어있으면 nil). 예산 때문에 트리로 옮기지 못하면 NULL
+ */
+node_t *rbtree_max_buffered(rbtree *t)
+{
+  const rbtree_wbuf *w = t->wbuf;
+  if (w != NULL && w->len > 0 &&
+      (t->root == t->nil || w->keys[w->start + w->len - 1] > rightmost(t, t->root)->key))
+  {
+    return wbuf_promote(t, w->len - 1);
+  }
+  return rbtree_max(t);
+}
@@ -3,30 +3,174 @@
 
 #include <stddef.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef enum { RBTREE_RED, RBTREE_BLACK } color_t;
 
 typedef int key_t;
 
+#ifdef RBTREE_AUGMENT
+// Every node keeps an associative summary of its subtree. A custom monoid is
+// bound at compile time with -DRBTREE_SUMMARY_HEADER='"file.h"'; that header
+// must define rbtree_summary_t and the three functions below.
+#ifdef RBTREE_SUMMARY_HEADER
+#include RBTREE_SUMMARY_HEADER
+#else
+#include <limits.h>
+
+// default summary: count, sum, min and max of the keys in a subtree
+typedef struct {
+  size_t count;
+  long long sum;
+  key_t min, max;
+} rbtree_summary_t;
+
+static inline rbtree_summary_t rbtree_summary_identity(void) {
+  rbtree_summary_t s = {0, 0, INT_MAX, INT_MIN};
+  return s;
+}
+
+static inline rbtree_summary_t rbtree_summary_of(const key_t key,
+                                                 const unsigned int count) {
+  rbtree_summary_t s = {count, (long long)key * count, key, key};
+  return s;
+}
+
+static inline rbtree_summary_t rbtree_summary_combine(
+    const rbtree_summary_t a, const rbtree_summary_t b) {
+  rbtree_summary_t s = {a.count + b.count, a.sum + b.sum,
+                        a.min < b.min ? a.min : b.min,
+                        a.max > b.max ? a.max : b.max};
+  return s;
+}
+#endif
+#endif
+
 typedef struct node_t {
   color_t color;
   key_t key;
   struct node_t *parent, *left, *right;
+  unsigned int count;  // number of equal keys held by this node (counted mode)
+  int lock;  // spinlock of the concurrent operations (nil's lock guards root)
+#ifdef RBTREE_AUGMENT
+  rbtree_summary_t summary;  // summary of the subtree rooted at this node
+#endif
 } node_t;
 
+struct rbtree;
+struct rbtree_hash;
+struct rbtree_wbuf;
+
+// what rbtree_insert does when a new node would exceed the memory budget
+// (a counted tree evicts per distinct key, dropping all copies of the key)
+typedef enum {
+  RBTREE_EVICT_NONE,     // refuse the insert (rbtree_insert returns NULL)
+  RBTREE_EVICT_MIN,      // erase the smallest keys first
+  RBTREE_EVICT_MAX,      // erase the largest keys first
+  RBTREE_EVICT_CALLBACK  // erase the node picked by the callback
+} rbtree_evict_t;
+
+// returns the node to erase next, or NULL to refuse the insert
+typedef node_t *(*rbtree_evict_fn)(const struct rbtree *, void *);
+
+// process-wide totals over every tree made by new_rbtree or rbtree_clone
 typedef struct {
+  size_t trees;          // live trees
+  size_t bytes;          // bytes held by live trees
+  size_t peak_bytes;     // highest value bytes has reached
+  size_t pending_bytes;  // bytes of deferred deletes not yet reclaimed
+} rbtree_memory_stats;
+
+typedef struct rbtree {
   node_t *root;
   node_t *nil;  // for sentinel
+  int counted;  // one node per distinct key with multiplicity in count
+  node_t *free_list;  // popped nodes kept for reuse by later inserts
+  node_t *block;      // contiguous node storage made by rbtree_compact
+  size_t block_len;
+  struct rbtree_hash *hash;  // optional key -> node index used by rbtree_find
+  struct rbtree_wbuf *wbuf;  // optional sorted run of inserts not yet merged
+  size_t bytes;   // header, nil, nodes, block, hash and buffer held by the tree
+  size_t nodes;   // nodes the tree allocated that are linked into it
+  size_t budget;  // upper bound on bytes enforced by rbtree_insert, 0 = none
+  rbtree_evict_t evict;
+  rbtree_evict_fn evict_fn;
+  void *evict_arg;
 } rbtree;
 
 rbtree *new_rbtree(void);
+rbtree *new_counted_rbtree(void);
 void delete_rbtree(rbtree *);
+void delete_rbtree_deferred(rbtree *);
+size_t rbtree_reclaim_step(const size_t);
 
 node_t *rbtree_insert(rbtree *, const key_t);
 node_t *rbtree_find(const rbtree *, const key_t);
+void rbtree_find_batch(const rbtree *, const key_t *, const size_t, node_t **);
 node_t *rbtree_min(const rbtree *);
 node_t *rbtree_max(const rbtree *);
 int rbtree_erase(rbtree *, node_t *);
+node_t *rbtree_update_key(rbtree *, node_t *, const key_t);
+
+int rbtree_pop_min(rbtree *, key_t *);
+int rbtree_pop_max(rbtree *, key_t *);
+size_t rbtree_drain_min(rbtree *, key_t *, const size_t);
 
 int rbtree_to_array(const rbtree *, key_t *, const size_t);
 
+#ifdef RBTREE_AUGMENT
+rbtree_summary_t rbtree_range_aggregate(const rbtree *, const key_t,
+                                        const key_t);
+#endif
+
+int rbtree_compact(rbtree *);
+rbtree *rbtree_clone(const rbtree *);
+
+int rbtree_enable_hash(rbtree *);
+void rbtree_disable_hash(rbtree *);
+
+// Reads taking a const tree never modify it and only see merged keys;
+// to_array and pop/drain see both. The *_buffered reads promote just the one
+// buffered key they return into the tree.
+int rbtree_enable_write_buffer(rbtree *, const size_t);
+int rbtree_disable_write_buffer(rbtree *);
+int rbtree_insert_buffered(rbtree *, const key_t);
+size_t rbtree_flush_step(rbtree *, const size_t);
+node_t *rbtree_find_buffered(rbtree *, const key_t);
+node_t *rbtree_min_buffered(rbtree *);
+node_t *rbtree_max_buffered(rbtree *);
+
+// Caller-allocated nodes linked with rbtree_link_after are not counted.
+size_t rbtree_memory_usage(const rbtree *);
+void rbtree_set_memory_budget(rbtree *, const size_t, const rbtree_evict_t);
+void rbtree_set_evict_callback(rbtree *, rbtree_evict_fn, void *);
+void rbtree_memory_registry(rbtree_memory_stats *);
+
+// Top-down variants rebalance on the way down and never walk back up.
+node_t *rbtree_insert_topdown(rbtree *, const key_t);
+int rbtree_erase_topdown(rbtree *, const key_t);
+
+#ifndef RBTREE_AUGMENT
+// Concurrent mode: writers lock-couple down a small window of nodes, so
+// operations on disjoint key ranges run in parallel. While several threads
+// use a tree, call only these; hash index, write buffer and budget must be off.
+int rbtree_insert_concurrent(rbtree *, const key_t);
+int rbtree_erase_concurrent(rbtree *, const key_t);
+int rbtree_find_concurrent(rbtree *, const key_t);
+#endif
+
+// Intrusive use: link/unlink caller-allocated nodes without touching keys.
+// The caller keeps ownership: remove them with rbtree_unlink (never erase or
+// pop), and empty the tree before delete_rbtree. rbtree_compact and
+// rbtree_clone must not be used while such nodes are linked.
+void rbtree_link_after(rbtree *, node_t *, node_t *);
+void rbtree_unlink(rbtree *, node_t *);
+node_t *rbtree_next(const rbtree *, node_t *);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif  // _RBTREE_H_
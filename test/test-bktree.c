@@ -0,0 +1,125 @@
+#include <assert.h>
+#include <bktree.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int comp(const void *p1, const void *p2) {
+  const key_t *e1 = (const key_t *)p1;
+  const key_t *e2 = (const key_t *)p2;
+  if (*e1 < *e2) {
+    return -1;
+  } else if (*e1 > *e2) {
+    return 1;
+  } else {
+    return 0;
+  }
+};
+
+// to_array should return the inserted keys in order
+static void check_array(const bktree *t, key_t *arr, const size_t n) {
+  assert(t->size == n);
+  qsort((void *)arr, n, sizeof(key_t), comp);
+
+  key_t *res = calloc(n, sizeof(key_t));
+  bktree_to_array(t, res, n);
+  for (int i = 0; i < n; i++) {
+    assert(arr[i] == res[i]);
+  }
+  free(res);
+
+  if (n > 0) {
+    key_t key;
+    assert(bktree_min(t, &key) == 0 && key == arr[0]);
+    assert(bktree_max(t, &key) == 0 && key == arr[n - 1]);
+  }
+}
+
+// buckets must stay sorted and non-empty, and index keys must be bucket mins
+static void check_buckets(const bktree *t) {
+  node_t *node = t->size ? rbtree_min(t->index) : NULL;
+  bool first = true;
+  key_t last = 0;
+  while (node != NULL) {
+    const bucket_t *b = (const bucket_t *)node;
+    assert(b->len > 0 && b->len <= BKTREE_BUCKET_CAP);
+    assert(node->key == b->keys[0]);
+    for (int i = 0; i < b->len; i++) {
+      assert(first || last <= b->keys[i]);
+      last = b->keys[i];
+      first = false;
+    }
+    node = rbtree_next(t->index, node);
+  }
+}
+
+void test_init(void) {
+  bktree *t = new_bktree();
+  assert(t != NULL);
+  key_t key;
+  assert(bktree_find(t, 1) == 0);
+  assert(bktree_min(t, &key) == -1);
+  assert(bktree_erase(t, 1) == -1);
+  delete_bktree(t);
+}
+
+// heavy duplicates should span several buckets and still be found
+void test_duplicates(void) {
+  bktree *t = new_bktree();
+  key_t arr[200];
+  const size_t n = sizeof(arr) / sizeof(arr[0]);
+  for (int i = 0; i < n; i++) {
+    arr[i] = (i % 3 == 0) ? 7 : 1000 - i;
+    bktree_insert(t, arr[i]);
+  }
+  check_buckets(t);
+  check_array(t, arr, n);
+
+  for (int i = 0; i < n; i += 3) {
+    assert(bktree_find(t, 7));
+    assert(bktree_erase(t, 7) == 0);
+  }
+  assert(!bktree_find(t, 7));
+  check_buckets(t);
+
+  delete_bktree(t);
+}
+
+// random insert/erase should match a sorted reference
+void test_find_erase_rand(const size_t n, const unsigned int seed) {
+  srand(seed);
+  bktree *t = new_bktree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % (int)n;
+    assert(bktree_insert(t, arr[i]) == 0);
+  }
+  check_buckets(t);
+
+  for (int i = 0; i < n; i++) {
+    assert(bktree_find(t, arr[i]));
+  }
+
+  // erase the first half and keep the rest as reference
+  for (int i = 0; i < n / 2; i++) {
+    assert(bktree_erase(t, arr[i]) == 0);
+  }
+  check_buckets(t);
+  check_array(t, arr + n / 2, n - n / 2);
+
+  for (int i = n / 2; i < n; i++) {
+    assert(bktree_erase(t, arr[i]) == 0);
+  }
+  assert(t->size == 0);
+  assert(bktree_find(t, arr[0]) == 0);
+
+  free(arr);
+  delete_bktree(t);
+}
+
+int main(void) {
+  test_init();
+  test_duplicates();
+  test_find_erase_rand(10000, 17);
+  printf("Passed all tests!\n");
+}
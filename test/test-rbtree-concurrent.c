@@ -0,0 +1,163 @@
+#include <assert.h>
+#include <pthread.h>
+#include <rbtree.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define THREADS 8
+#define ROUNDS 4
+#define KEYS_PER_THREAD 4000
+#define HOT_KEYS 16
+
+typedef struct {
+  rbtree *t;
+  int id;
+  int round;
+} worker_arg;
+
+// Each thread owns the keys equal to its id modulo THREADS, so the final
+// contents are deterministic. All threads also insert and erase the same few
+// hot keys to make writers meet near the root and on shared paths.
+static void *worker(void *p) {
+  const worker_arg *arg = (const worker_arg *)p;
+  rbtree *t = arg->t;
+  unsigned int seed = arg->id * 7919 + arg->round;
+
+  for (int i = 0; i < KEYS_PER_THREAD; i++) {
+    const key_t key = i * THREADS + arg->id;
+    assert(rbtree_insert_concurrent(t, key) == 0);
+
+    const key_t hot = -1 - rand_r(&seed) % HOT_KEYS;
+    assert(rbtree_insert_concurrent(t, hot) == 0);
+    assert(rbtree_find_concurrent(t, key));
+    // the hot key cannot disappear: our own copy is still in the tree
+    assert(rbtree_find_concurrent(t, hot));
+    assert(rbtree_erase_concurrent(t, hot) == 0);
+
+    // erase the odd-indexed own keys again, keep the rest for the next round
+    if (i % 2 == 1) {
+      assert(rbtree_erase_concurrent(t, key) == 0);
+      assert(!rbtree_find_concurrent(t, key));
+    }
+  }
+  return NULL;
+}
+
+// Search tree constraint, plus parent pointers that agree with child pointers
+static bool search_traverse(const node_t *p, key_t *min, key_t *max,
+                            node_t *nil) {
+  if (p == nil) {
+    return true;
+  }
+  if ((p->left != nil && p->left->parent != p) ||
+      (p->right != nil && p->right->parent != p)) {
+    return false;
+  }
+
+  key_t l_min, l_max, r_min, r_max;
+  l_min = l_max = r_min = r_max = p->key;
+
+  const bool lr = search_traverse(p->left, &l_min, &l_max, nil);
+  if (!lr || l_max > p->key) {
+    return false;
+  }
+  const bool rr = search_traverse(p->right, &r_min, &r_max, nil);
+  if (!rr || r_min < p->key) {
+    return false;
+  }
+
+  *min = l_min;
+  *max = r_max;
+  return true;
+}
+
+// Color constraint, same as test-rbtree.c
+static bool touch_nil;
+static int max_black_depth;
+
+static bool color_traverse(const node_t *p, const color_t parent_color,
+                           const int black_depth, node_t *nil) {
+  if (p == nil) {
+    if (!touch_nil) {
+      touch_nil = true;
+      max_black_depth = black_depth;
+    } else if (black_depth != max_black_depth) {
+      return false;
+    }
+    return true;
+  }
+  if (parent_color == RBTREE_RED && p->color == RBTREE_RED) {
+    return false;
+  }
+  int next_depth = ((p->color == RBTREE_BLACK) ? 1 : 0) + black_depth;
+  return color_traverse(p->left, p->color, next_depth, nil) &&
+         color_traverse(p->right, p->color, next_depth, nil);
+}
+
+static void check_constraints(const rbtree *t) {
+  key_t min, max;
+  assert(t->root == t->nil || t->root->parent == t->nil);
+  assert(search_traverse(t->root, &min, &max, t->nil));
+
+  assert(t->root == t->nil || t->root->color == RBTREE_BLACK);
+  touch_nil = false;
+  max_black_depth = 0;
+  assert(color_traverse(t->root, RBTREE_BLACK, 0, t->nil));
+}
+
+// After round r every thread keeps the even-indexed own keys, which are the
+// same keys each round, one copy per round.
+static void check_contents(const rbtree *t, const int rounds) {
+  const size_t n = (size_t)THREADS * KEYS_PER_THREAD / 2 * rounds;
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  res[n] = -1;
+  rbtree_to_array(t, res, n + 1);
+
+  size_t i = 0;
+  for (int k = 0; k < KEYS_PER_THREAD; k += 2) {
+    for (int id = 0; id < THREADS; id++) {
+      for (int r = 0; r < rounds; r++) {
+        assert(res[i++] == k * THREADS + id);
+      }
+    }
+  }
+  // no hot keys (negative) remain and nothing extra was inserted
+  assert(i == n && res[n] == -1);
+  free(res);
+}
+
+void test_concurrent_stress(void) {
+  rbtree *t = new_rbtree();
+  pthread_t threads[THREADS];
+  worker_arg args[THREADS];
+
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int i = 0; i < THREADS; i++) {
+      args[i].t = t;
+      args[i].id = i;
+      args[i].round = r;
+      assert(pthread_create(&threads[i], NULL, worker, &args[i]) == 0);
+    }
+    for (int i = 0; i < THREADS; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    check_constraints(t);
+    check_contents(t, r + 1);
+  }
+
+  // the tree stays usable by the single-threaded operations
+  node_t *p = rbtree_find(t, 0);
+  assert(p != NULL);
+  rbtree_erase(t, p);
+  rbtree_insert(t, 0);
+  check_constraints(t);
+  check_contents(t, ROUNDS);
+
+  delete_rbtree(t);
+}
+
+int main(void) {
+  test_concurrent_stress();
+  printf("Passed all tests!\n");
+}
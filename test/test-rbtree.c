@@ -3,6 +3,8 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 // new_rbtree should return rbtree struct with null root node
 void test_init(void) {
@@ -205,6 +207,33 @@ static bool search_traverse(const node_t *p, key_t *min, key_t *max,
   return true;
 }
 
+#ifdef RBTREE_AUGMENT
+// Augmentation constraint
+// The summary of every node should equal the summary recomputed from its
+// subtree.
+
+static bool same_summary(const rbtree_summary_t a, const rbtree_summary_t b) {
+  return a.count == b.count && a.sum == b.sum && a.min == b.min &&
+         a.max == b.max;
+}
+
+static bool summary_traverse(const node_t *p, rbtree_summary_t *s,
+                             node_t *nil) {
+  if (p == nil) {
+    *s = rbtree_summary_identity();
+    return same_summary(p->summary, *s);
+  }
+  rbtree_summary_t l, r;
+  if (!summary_traverse(p->left, &l, nil) ||
+      !summary_traverse(p->right, &r, nil)) {
+    return false;
+  }
+  *s = rbtree_summary_combine(
+      rbtree_summary_combine(l, rbtree_summary_of(p->key, p->count)), r);
+  return same_summary(p->summary, *s);
+}
+#endif
+
 void test_search_constraint(const rbtree *t) {
   assert(t != NULL);
   node_t *p = t->root;
@@ -215,6 +244,10 @@ void test_search_constraint(const rbtree *t) {
   node_t *nil = NULL;
 #endif
   assert(search_traverse(p, &min, &max, nil));
+#ifdef RBTREE_AUGMENT
+  rbtree_summary_t s;
+  assert(summary_traverse(p, &s, nil));
+#endif
 }
 
 // Color constraint
@@ -367,6 +400,746 @@ void test_find_erase_rand(const size_t n, const unsigned int seed) {
   delete_rbtree(t);
 }
 
+// counted rbtree should keep one node per distinct key and expand counts
+void test_counted_duplicates() {
+  rbtree *t = new_counted_rbtree();
+  assert(t != NULL);
+
+  key_t entries[] = {10, 5, 5, 34, 6, 23, 12, 12, 6, 12};
+  const size_t n = sizeof(entries) / sizeof(entries[0]);
+  insert_arr(t, entries, n);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  node_t *p = rbtree_find(t, 12);
+  assert(p != NULL);
+  assert(p->count == 3);
+  assert(rbtree_insert(t, 12) == p);
+  assert(p->count == 4);
+
+  rbtree_erase(t, p);
+  assert(rbtree_find(t, 12) == p);
+  assert(p->count == 3);
+
+  qsort((void *)entries, n, sizeof(key_t), comp);
+  key_t *res = calloc(n, sizeof(key_t));
+  rbtree_to_array(t, res, n);
+  for (int i = 0; i < n; i++) {
+    assert(entries[i] == res[i]);
+  }
+  free(res);
+
+  // erasing every copy should remove the node itself
+  for (int i = 0; i < 3; i++) {
+    p = rbtree_find(t, 12);
+    assert(p != NULL);
+    rbtree_erase(t, p);
+  }
+  assert(rbtree_find(t, 12) == NULL);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  delete_rbtree(t);
+}
+
+// pop/drain should remove elements from the ends in key order
+void test_pop_drain(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % (n / 2);
+  }
+  insert_arr(t, arr, n);
+  qsort((void *)arr, n, sizeof(key_t), comp);
+
+  key_t key;
+  assert(rbtree_pop_min(t, &key) == 0);
+  assert(key == arr[0]);
+  assert(rbtree_pop_max(t, &key) == 0);
+  assert(key == arr[n - 1]);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  // popped nodes are reused by later inserts
+  node_t *recycled = t->free_list;
+  assert(recycled != NULL);
+  assert(rbtree_insert(t, arr[0]) == recycled);
+  assert(rbtree_insert(t, arr[n - 1]) != NULL);
+
+  key_t *res = calloc(n, sizeof(key_t));
+  const size_t half = n / 2;
+  assert(rbtree_drain_min(t, res, half) == half);
+  assert(rbtree_drain_min(t, res + half, n) == n - half);
+  for (int i = 0; i < n; i++) {
+    assert(arr[i] == res[i]);
+  }
+  assert(t->root == t->nil);
+  assert(rbtree_pop_min(t, &key) == -1);
+  assert(rbtree_pop_max(t, &key) == -1);
+
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+
+// update_key should move the same node to its new position
+void test_update_key(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  node_t **nodes = calloc(n, sizeof(node_t *));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % (int)(4 * n);
+    nodes[i] = rbtree_insert(t, arr[i]);
+  }
+
+  for (int i = 0; i < n; i++) {
+    // alternate small nudges and jumps across the tree
+    const key_t new_key =
+        (i % 2) ? arr[i] + 1 : rand() % (int)(4 * n);
+    assert(rbtree_update_key(t, nodes[i], new_key) == nodes[i]);
+    assert(nodes[i]->key == new_key);
+    arr[i] = new_key;
+  }
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  qsort((void *)arr, n, sizeof(key_t), comp);
+  key_t *res = calloc(n, sizeof(key_t));
+  rbtree_to_array(t, res, n);
+  for (int i = 0; i < n; i++) {
+    assert(arr[i] == res[i]);
+  }
+
+  // counted mode merges into an existing node with the same key
+  rbtree *c = new_counted_rbtree();
+  node_t *p = rbtree_insert(c, 3);
+  node_t *q = rbtree_insert(c, 7);
+  rbtree_insert(c, 7);
+  assert(rbtree_update_key(c, p, 7) == q);
+  assert(q->count == 3);
+  assert(rbtree_find(c, 3) == NULL);
+  test_color_constraint(c);
+
+  delete_rbtree(c);
+  free(res);
+  free(nodes);
+  free(arr);
+  delete_rbtree(t);
+}
+
+// find_batch should give the same nodes as rbtree_find
+void test_find_batch(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % (int)(2 * n);
+    if (i % 2 == 0) {
+      rbtree_insert(t, arr[i]);
+    }
+  }
+
+  node_t **nodes = calloc(n, sizeof(node_t *));
+  rbtree_find_batch(t, arr, n, nodes);
+  for (int i = 0; i < n; i++) {
+    assert(nodes[i] == rbtree_find(t, arr[i]));
+    if (i % 2 == 0) {
+      assert(nodes[i] != NULL);
+    }
+  }
+
+  free(nodes);
+  free(arr);
+  delete_rbtree(t);
+}
+
+// compact should relocate nodes into one block and keep the tree mutable
+void test_compact(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand();
+  }
+  insert_arr(t, arr, n);
+
+  assert(rbtree_compact(t) == 0);
+  assert(t->block_len == n);
+  assert(t->root == t->block);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  // erase half of the nodes, insert them back and compact again
+  for (int i = 0; i < n; i += 2) {
+    node_t *p = rbtree_find(t, arr[i]);
+    assert(p != NULL);
+    rbtree_erase(t, p);
+  }
+  for (int i = 0; i < n; i += 2) {
+    assert(rbtree_insert(t, arr[i]) != NULL);
+  }
+  assert(rbtree_compact(t) == 0);
+  assert(t->free_list == NULL);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  qsort((void *)arr, n, sizeof(key_t), comp);
+  key_t *res = calloc(n, sizeof(key_t));
+  rbtree_to_array(t, res, n);
+  for (int i = 0; i < n; i++) {
+    assert(arr[i] == res[i]);
+  }
+
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+
+// hash index should agree with the tree through every kind of update
+void test_hash_index(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  rbtree *ref = new_rbtree();
+  const int range = (int)n / 2;
+  for (int i = 0; i < n / 2; i++) {
+    const key_t key = rand() % range;
+    rbtree_insert(t, key);
+    rbtree_insert(ref, key);
+  }
+  assert(rbtree_enable_hash(t) == 0);
+
+  key_t popped;
+  for (int i = 0; i < n; i++) {
+    const key_t key = rand() % range;
+    node_t *p = rbtree_find(t, key);
+    node_t *q = rbtree_find(ref, key);
+    assert((p == NULL) == (q == NULL));
+    switch (i % 5) {
+      case 0:
+      case 1:
+        rbtree_insert(t, key);
+        rbtree_insert(ref, key);
+        break;
+      case 2:
+        if (p != NULL) {
+          assert(p->key == key);
+          rbtree_erase(t, p);
+          rbtree_erase(ref, q);
+        }
+        break;
+      case 3:
+        if (p != NULL) {
+          rbtree_update_key(t, p, key + 7);
+          rbtree_update_key(ref, q, key + 7);
+        }
+        break;
+      default:
+        rbtree_pop_min(t, &popped);
+        rbtree_pop_min(ref, &popped);
+        break;
+    }
+    if (i == n / 2) {
+      assert(rbtree_compact(t) == 0);
+    }
+  }
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  // erase everything through the index; the tree must end up empty
+  for (int key = 0; key < range + 7; key++) {
+    node_t *p;
+    while ((p = rbtree_find(t, key)) != NULL) {
+      assert(p->key == key);
+      node_t *q = rbtree_find(ref, key);
+      assert(q != NULL);
+      rbtree_erase(t, p);
+      rbtree_erase(ref, q);
+    }
+    assert(rbtree_find(ref, key) == NULL);
+  }
+  assert(t->root == t->nil);
+
+  rbtree_disable_hash(t);
+  delete_rbtree(ref);
+  delete_rbtree(t);
+}
+
+// buffered inserts should be visible to reads before they are merged
+void test_write_buffer(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  assert(rbtree_enable_write_buffer(t, 64) == 0);
+  key_t *arr = calloc(n, sizeof(key_t));
+  key_t *res = calloc(n + 20, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % (int)n;
+    assert(rbtree_insert_buffered(t, arr[i]) == 0);
+  }
+
+  // to_array merges the pending keys without touching the tree
+  key_t *sorted = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    sorted[i] = arr[i];
+  }
+  qsort((void *)sorted, n, sizeof(key_t), comp);
+  rbtree_to_array(t, res, n);
+  for (int i = 0; i < n; i++) {
+    assert(sorted[i] == res[i]);
+  }
+  rbtree_to_array(t, res, 10);
+  for (int i = 0; i < 10; i++) {
+    assert(sorted[i] == res[i]);
+  }
+
+  // const reads only see the tree; the buffered reads promote one key each
+  assert(rbtree_insert_buffered(t, (int)n + 5) == 0);
+  assert(rbtree_find(t, (int)n + 5) == NULL);
+  const size_t pending = rbtree_flush_step(t, 0);
+  node_t *p = rbtree_find_buffered(t, (int)n + 5);
+  assert(p != NULL && p->key == (int)n + 5);
+  assert(rbtree_flush_step(t, 0) == pending - 1);
+  assert(rbtree_find(t, (int)n + 5) == p);
+  rbtree_erase(t, p);
+
+  // every key is findable, and the buffered min/max see the buffer
+  p = rbtree_min_buffered(t);
+  assert(p != t->nil && p->key == sorted[0]);
+  p = rbtree_max_buffered(t);
+  assert(p != t->nil && p->key == sorted[n - 1]);
+  for (int i = 0; i < n; i++) {
+    p = rbtree_find_buffered(t, arr[i]);
+    assert(p != NULL && p->key == arr[i]);
+  }
+  assert(rbtree_find_buffered(t, -5) == NULL);
+  // duplicates of keys already in the tree stay buffered until flushed
+  assert(rbtree_flush_step(t, n) == 0);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  // pops take from whichever of the tree and the buffer holds the end
+  assert(rbtree_insert_buffered(t, -1) == 0);
+  assert(rbtree_insert_buffered(t, (int)n) == 0);
+  key_t key;
+  assert(rbtree_pop_min(t, &key) == 0 && key == -1);
+  assert(rbtree_pop_max(t, &key) == 0 && key == (int)n);
+  for (int i = 0; i < 20; i++) {
+    rbtree_insert_buffered(t, sorted[i]);
+  }
+  assert(rbtree_flush_step(t, 5) == 15);
+  assert(rbtree_drain_min(t, res, n + 20) == n + 20);
+  for (int i = 0, j = 0; i < n + 20; i++) {
+    assert(res[i] == sorted[j]);
+    // the 20 smallest keys are present twice
+    if (i >= 2 * 20 || i % 2 == 1) {
+      j++;
+    }
+  }
+  assert(rbtree_pop_min(t, &key) == -1);
+
+  rbtree_disable_write_buffer(t);
+  free(sorted);
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+
+// clone should copy structure and colors and then evolve independently
+void test_clone(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand();
+  }
+  insert_arr(t, arr, n);
+  assert(rbtree_enable_hash(t) == 0);
+
+  rbtree *c = rbtree_clone(t);
+  assert(c != NULL && c->nil != t->nil);
+  assert(c->root->key == t->root->key);
+  assert(c->root->color == t->root->color);
+  test_color_constraint(c);
+  test_search_constraint(c);
+
+  // erase everything from the original; the clone keeps all keys
+  for (int i = 0; i < n; i++) {
+    node_t *p = rbtree_find(t, arr[i]);
+    assert(p != NULL);
+    rbtree_erase(t, p);
+    assert(rbtree_find(c, arr[i]) != NULL);
+  }
+  assert(t->root == t->nil);
+
+  qsort((void *)arr, n, sizeof(key_t), comp);
+  key_t *res = calloc(n, sizeof(key_t));
+  rbtree_to_array(c, res, n);
+  for (int i = 0; i < n; i++) {
+    assert(arr[i] == res[i]);
+  }
+
+  // an empty tree clones to an empty tree
+  rbtree *e = rbtree_clone(t);
+  assert(e != NULL && e->root == e->nil);
+
+  delete_rbtree(e);
+  free(res);
+  free(arr);
+  delete_rbtree(c);
+  delete_rbtree(t);
+}
+
+// deferred delete should return memory in bounded steps
+void test_deferred_delete(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t1 = new_rbtree();
+  rbtree *t2 = new_rbtree();
+  for (int i = 0; i < n; i++) {
+    rbtree_insert(t1, rand());
+    rbtree_insert(t2, rand());
+  }
+  // nodes in a compacted block and on the free list are reclaimed too
+  assert(rbtree_compact(t2) == 0);
+  key_t key;
+  rbtree_pop_min(t2, &key);
+  rbtree_insert(t2, key);
+  rbtree_pop_max(t2, &key);
+
+  delete_rbtree_deferred(t1);
+  delete_rbtree_deferred(t2);
+  delete_rbtree_deferred(new_rbtree());
+
+  size_t steps = 0;
+  while (rbtree_reclaim_step(100) > 0) {
+    steps++;
+  }
+  // each step frees at most 100 nodes
+  assert(steps >= 2 * n / 100);
+  assert(rbtree_reclaim_step(100) == 0);
+}
+
+// evict callback for test_memory_budget: erase the root, or refuse once told to
+static node_t *evict_root(const rbtree *t, void *arg) {
+  int *calls = (int *)arg;
+  (*calls)++;
+  return (*calls > 100) ? NULL : t->root;
+}
+
+// evict callback counting its calls and picking the smallest key
+static node_t *evict_min(const rbtree *t, void *arg) {
+  (*(int *)arg)++;
+  return rbtree_min(t);
+}
+
+// nodes linked from uninitialized caller memory should behave like inserted ones
+void test_link_after(void) {
+  rbtree *t = new_rbtree();
+  node_t *nodes[3];
+  for (int i = 0; i < 3; i++) {
+    nodes[i] = malloc(sizeof(node_t));
+    memset(nodes[i], 0xff, sizeof(node_t));
+    nodes[i]->key = i + 1;
+    rbtree_link_after(t, i == 0 ? NULL : nodes[i - 1], nodes[i]);
+  }
+
+  key_t res[4] = {0, 0, 0, 0};
+  rbtree_to_array(t, res, 4);
+  assert(res[0] == 1 && res[1] == 2 && res[2] == 3 && res[3] == 0);
+#ifdef RBTREE_AUGMENT
+  rbtree_summary_t s = rbtree_range_aggregate(t, 0, 10);
+  assert(s.count == 3 && s.sum == 6);
+#endif
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  for (int i = 0; i < 3; i++) {
+    rbtree_unlink(t, nodes[i]);
+    free(nodes[i]);
+  }
+  assert(t->root == t->nil);
+  delete_rbtree(t);
+}
+
+// accounting should follow every allocation and the budget should hold
+void test_memory_budget(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree_memory_stats before, after;
+  rbtree_memory_registry(&before);
+
+  rbtree *t = new_rbtree();
+  const size_t empty = rbtree_memory_usage(t);
+  assert(empty > 0);
+  for (int i = 0; i < n; i++) {
+    rbtree_insert(t, rand());
+  }
+  assert(rbtree_memory_usage(t) == empty + n * sizeof(node_t));
+
+  // auxiliary structures are counted and given back
+  assert(rbtree_enable_hash(t) == 0);
+  assert(rbtree_enable_write_buffer(t, 64) == 0);
+  assert(rbtree_memory_usage(t) > empty + n * sizeof(node_t));
+  rbtree_disable_hash(t);
+  rbtree_disable_write_buffer(t);
+  assert(rbtree_memory_usage(t) == empty + n * sizeof(node_t));
+  assert(rbtree_compact(t) == 0);
+  assert(rbtree_memory_usage(t) == empty + n * sizeof(node_t));
+
+  rbtree_memory_registry(&after);
+  assert(after.trees == before.trees + 1);
+  assert(after.bytes == before.bytes + rbtree_memory_usage(t));
+  assert(after.peak_bytes >= after.bytes);
+
+  // evict min: the smallest keys leave, the tree stays within budget
+  const size_t budget = empty + n / 2 * sizeof(node_t);
+  rbtree *lru = new_rbtree();
+  rbtree_set_memory_budget(lru, budget, RBTREE_EVICT_MIN);
+  for (int i = 0; i < n; i++) {
+    assert(rbtree_insert(lru, i) != NULL);
+    assert(rbtree_memory_usage(lru) <= budget);
+  }
+  assert(rbtree_min(lru)->key == n - n / 2);
+  assert(rbtree_max(lru)->key == n - 1);
+  test_color_constraint(lru);
+  test_search_constraint(lru);
+
+  // evict max keeps the smallest keys
+  rbtree_set_memory_budget(lru, budget, RBTREE_EVICT_MAX);
+  for (int i = 0; i < n; i++) {
+    assert(rbtree_insert(lru, -i) != NULL);
+  }
+  assert(rbtree_max(lru)->key == -(int)(n - n / 2));
+  assert(rbtree_memory_usage(lru) <= budget);
+
+  // no eviction: inserts are refused once the budget is reached
+  rbtree_set_memory_budget(lru, budget, RBTREE_EVICT_NONE);
+  assert(rbtree_insert(lru, 0) == NULL);
+  assert(rbtree_find(lru, 0) == NULL);
+
+  // callback picks the victim, and can refuse
+  int calls = 0;
+  rbtree_set_evict_callback(lru, evict_root, &calls);
+  rbtree_set_memory_budget(lru, budget, RBTREE_EVICT_CALLBACK);
+  for (int i = 0; i < 100; i++) {
+    assert(rbtree_insert(lru, i) != NULL);
+  }
+  assert(calls == 100);
+  assert(rbtree_insert(lru, 100) == NULL);
+  test_color_constraint(lru);
+  test_search_constraint(lru);
+
+  // a counted tree evicts a hot key with all its copies in one step
+  rbtree *hot = new_counted_rbtree();
+  rbtree_set_memory_budget(hot, rbtree_memory_usage(hot) + 4 * sizeof(node_t),
+                           RBTREE_EVICT_CALLBACK);
+  for (int i = 0; i < 100000; i++) {
+    assert(rbtree_insert(hot, 0) != NULL);
+  }
+  for (int i = 1; i < 4; i++) {
+    assert(rbtree_insert(hot, i) != NULL);
+  }
+  int hot_calls = 0;
+  rbtree_set_evict_callback(hot, evict_min, &hot_calls);
+  assert(rbtree_insert(hot, 4) != NULL);
+  assert(hot_calls == 1);
+  assert(rbtree_find(hot, 0) == NULL);
+  assert(rbtree_min(hot)->key == 1);
+  delete_rbtree(hot);
+
+  // a budget that evicting every node cannot meet is refused untouched
+  const size_t kept = rbtree_memory_usage(lru);
+  const key_t lo = rbtree_min(lru)->key;
+  rbtree_set_memory_budget(lru, empty, RBTREE_EVICT_MIN);
+  assert(rbtree_insert(lru, lo - 1) == NULL);
+  assert(rbtree_insert_topdown(lru, lo - 1) == NULL);
+  assert(rbtree_memory_usage(lru) == kept);
+  assert(rbtree_min(lru)->key == lo);
+
+  // buffered keys the budget refuses stay in the buffer instead of being lost
+  rbtree *buf = new_rbtree();
+  assert(rbtree_enable_write_buffer(buf, 4) == 0);
+  rbtree_set_memory_budget(buf, rbtree_memory_usage(buf) + 2 * sizeof(node_t),
+                           RBTREE_EVICT_NONE);
+  for (int i = 0; i < 6; i++) {
+    assert(rbtree_insert_buffered(buf, i) == 0);
+  }
+  assert(rbtree_insert_buffered(buf, 6) == -1);
+  assert(rbtree_flush_step(buf, 10) == 4);
+  assert(rbtree_disable_write_buffer(buf) == -1);
+  key_t kept_keys[7] = {-1, -1, -1, -1, -1, -1, -1};
+  rbtree_to_array(buf, kept_keys, 7);
+  for (int i = 0; i < 6; i++) {
+    assert(kept_keys[i] == i);
+  }
+  assert(kept_keys[6] == -1);
+  rbtree_set_memory_budget(buf, 0, RBTREE_EVICT_NONE);
+  assert(rbtree_disable_write_buffer(buf) == 0);
+  rbtree_to_array(buf, kept_keys, 7);
+  for (int i = 0; i < 6; i++) {
+    assert(kept_keys[i] == i);
+  }
+  delete_rbtree(buf);
+
+  // a deferred delete moves the bytes to pending until reclaimed
+  const size_t held = rbtree_memory_usage(t);
+  delete_rbtree_deferred(t);
+  rbtree_memory_registry(&after);
+  assert(after.pending_bytes >= held - sizeof(rbtree));
+  while (rbtree_reclaim_step(100) > 0) {
+  }
+  delete_rbtree(lru);
+  rbtree_memory_registry(&after);
+  assert(after.trees == before.trees);
+  assert(after.bytes == before.bytes);
+  assert(after.pending_bytes == before.pending_bytes);
+}
+
+// a full budgeted tree should keep inserting at O(log n): the eviction check
+// must not walk the tree
+void test_budget_at_capacity(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  rbtree_set_memory_budget(t, rbtree_memory_usage(t) + n * sizeof(node_t),
+                           RBTREE_EVICT_MIN);
+
+  const clock_t start = clock();
+  for (size_t i = 0; i < 2 * n; i++) {
+    assert(rbtree_insert(t, rand()) != NULL);
+    if (i == n + n / 2) {
+      // nodes moved into the compact block are still counted
+      assert(rbtree_compact(t) == 0);
+    }
+  }
+  for (size_t i = 0; i < n; i++) {
+    assert(rbtree_insert_topdown(t, rand()) != NULL);
+  }
+  // an O(n) check per insert takes minutes here, O(log n) a fraction of a second
+  assert(clock() - start < 10 * CLOCKS_PER_SEC);
+
+  assert(t->nodes == n);
+  assert(rbtree_memory_usage(t) <= t->budget);
+  test_color_constraint(t);
+  test_search_constraint(t);
+  delete_rbtree(t);
+}
+
+// top-down insert/erase should keep the tree valid and interoperate with the
+// bottom-up operations
+void test_topdown(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % (int)n;  // plenty of duplicates
+    node_t *p = (i % 3) ? rbtree_insert_topdown(t, arr[i]) : rbtree_insert(t, arr[i]);
+    assert(p != NULL && p->key == arr[i]);
+    if (i % 64 == 0) {
+      test_color_constraint(t);
+      test_search_constraint(t);
+    }
+  }
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  // erase half by key, mixing in node erases
+  for (int i = 0; i < n / 2; i++) {
+    if (i % 3) {
+      assert(rbtree_erase_topdown(t, arr[i]) == 0);
+    } else {
+      rbtree_erase(t, rbtree_find(t, arr[i]));
+    }
+    if (i % 64 == 0) {
+      test_color_constraint(t);
+      test_search_constraint(t);
+    }
+  }
+  assert(rbtree_erase_topdown(t, -1) == -1);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  key_t *res = calloc(n, sizeof(key_t));
+  qsort((void *)(arr + n / 2), n - n / 2, sizeof(key_t), comp);
+  assert(rbtree_to_array(t, res, n - n / 2) == 0);
+  for (int i = 0; i < n - n / 2; i++) {
+    assert(res[i] == arr[n / 2 + i]);
+  }
+  for (int i = n / 2; i < n; i++) {
+    assert(rbtree_erase_topdown(t, arr[i]) == 0);
+  }
+  assert(t->root == t->nil);
+  assert(rbtree_erase_topdown(t, 0) == -1);
+
+  // counted mode keeps one node per key
+  rbtree *c = new_counted_rbtree();
+  node_t *p = rbtree_insert_topdown(c, 7);
+  assert(rbtree_insert_topdown(c, 7) == p && p->count == 2);
+  assert(rbtree_erase_topdown(c, 7) == 0 && p->count == 1);
+  assert(rbtree_erase_topdown(c, 7) == 0 && c->root == c->nil);
+
+  // a duplicate needs no new node, so a full budget neither evicts nor refuses
+  for (int i = 0; i < 4; i++) {
+    assert(rbtree_insert_topdown(c, i) != NULL);
+  }
+  rbtree_set_memory_budget(c, rbtree_memory_usage(c), RBTREE_EVICT_MIN);
+  p = rbtree_insert_topdown(c, 2);
+  assert(p != NULL && p->key == 2 && p->count == 2);
+  assert(rbtree_min(c)->key == 0);
+  rbtree_set_memory_budget(c, rbtree_memory_usage(c), RBTREE_EVICT_NONE);
+  assert(rbtree_insert_topdown(c, 0) == rbtree_find(c, 0));
+  assert(rbtree_find(c, 0)->count == 2);
+  assert(rbtree_insert_topdown(c, 4) == NULL);
+  // a new key still evicts under EVICT_MIN
+  rbtree_set_memory_budget(c, rbtree_memory_usage(c), RBTREE_EVICT_MIN);
+  assert(rbtree_insert_topdown(c, 4) != NULL);
+  assert(rbtree_find(c, 0) == NULL && rbtree_min(c)->key == 1);
+  test_color_constraint(c);
+  test_search_constraint(c);
+
+  delete_rbtree(c);
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+
+#ifdef RBTREE_AUGMENT
+// range_aggregate should match a scan over the sorted keys
+void test_range_aggregate(const size_t n, const unsigned int seed) {
+  srand(seed);
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  const int range = (int)n;
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % range;
+    rbtree_insert(t, arr[i]);
+  }
+  // erase a few nodes so the summaries go through the erase paths as well
+  for (int i = 0; i < n; i += 4) {
+    rbtree_erase(t, rbtree_find(t, arr[i]));
+  }
+  test_search_constraint(t);
+
+  key_t *res = calloc(n, sizeof(key_t));
+  rbtree_to_array(t, res, n);
+  const size_t len = t->root->summary.count;
+
+  for (int i = 0; i < 200; i++) {
+    key_t lo = rand() % range - 10, hi = lo + rand() % (range / 4);
+    rbtree_summary_t want = rbtree_summary_identity();
+    for (int j = 0; j < len; j++) {
+      if (res[j] >= lo && res[j] <= hi) {
+        want = rbtree_summary_combine(want, rbtree_summary_of(res[j], 1));
+      }
+    }
+    assert(same_summary(rbtree_range_aggregate(t, lo, hi), want));
+  }
+  assert(rbtree_range_aggregate(t, 10, 5).count == 0);
+
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+#endif
+
 int main(void) {
   test_init();
   test_insert_single(1024);
@@ -379,5 +1152,21 @@ int main(void) {
   test_duplicate_values();
   test_multi_instance();
   test_find_erase_rand(10000, 17);
+  test_counted_duplicates();
+  test_pop_drain(1000, 29);
+  test_update_key(1000, 31);
+  test_find_batch(1001, 37);
+  test_compact(1000, 41);
+  test_hash_index(2000, 43);
+  test_write_buffer(1000, 53);
+  test_clone(1000, 59);
+  test_deferred_delete(1000, 61);
+  test_link_after();
+  test_memory_budget(1000, 67);
+  test_budget_at_capacity(1 << 18, 73);
+  test_topdown(2000, 71);
+#ifdef RBTREE_AUGMENT
+  test_range_aggregate(1000, 47);
+#endif
   printf("Passed all tests!\n");
 }